@@ -34,16 +34,21 @@
 #define _ApiIF_hpp_
 
 #include <string>
+#include <list>
+#include <vector>
+#include <time.h>
 
 #include <common.h>
 #include <Channel.hpp>
 
+#define API_LATENCY_SAMPLES 10000 /* max. number of latencies kept per statistics interval */
+
 namespace vz {
 	class ApiIF {
 	public:
 		typedef vz::shared_ptr<ApiIF> Ptr;
 
-		ApiIF(Channel::Ptr ch) : _ch(ch){}
+		ApiIF(Channel::Ptr ch);
 		virtual ~ApiIF(){};
 
 /** 
@@ -52,12 +57,45 @@ namespace vz {
  **/
 		virtual void send() = 0;
 		virtual	void register_device()  = 0;
+
+		/**
+		 * @return true if the last request failed and its readings are still pending
+		 */
+		bool retrying() const { return _retrying; }
 		
 	protected:
 		Channel::Ptr channel() { return _ch; }
 
+		/**
+		 * Account readings which have been accepted by the middleware
+		 *
+		 * @param values the readings of the successful request
+		 * @param duration time the request took, in seconds
+		 */
+		void delivered(const std::list<Reading> &values, double duration);
+
+		/**
+		 * Account a failed request
+		 */
+		void failed();
+
 	private:
+		/**
+		 * Log delivery statistics if the statistics interval has passed
+		 */
+		void _report();
+
 		Channel::Ptr _ch;   /**< pointer to channel where API belongs to */
+		bool _retrying;     /**< the last request failed */
+
+		int _stats_interval;             /**< seconds between two reports, 0 to disable */
+		struct timespec _stats_time;     /**< time of the last report */
+		std::vector<double> _latencies;  /**< reading to delivery latencies, sampled */
+		unsigned long _delivered;        /**< readings delivered since the last report */
+		unsigned long _requests;         /**< successful requests since the last report */
+		unsigned long _failures;         /**< failed requests since the last report */
+		double _duration;                /**< total duration of successful requests */
+		unsigned int _random;            /**< state for reservoir sampling */
 	}; //class ApiIF
 
 } // namespace vz
@@ -35,7 +35,7 @@
 #include <Options.hpp>
 #include <VZException.hpp>
 
-class Channel {
+class Channel : public vz::enable_shared_from_this<Channel> {
 
 	public:
 	typedef vz::shared_ptr<Channel> Ptr;
@@ -53,6 +53,29 @@ class Channel {
 		_thread_running = false;
 	}
 
+	/**
+	 * Wait for the logging thread to terminate
+	 *
+	 * @param deadline absolute time on CLOCK_REALTIME
+	 * @return false if the thread is still running at the deadline
+	 */
+	bool join(const struct timespec &deadline) {
+		if (pthread_timedjoin_np(_thread, NULL, &deadline) != 0) return false;
+		_thread_running = false;
+		return true;
+	}
+
+	/**
+	 * Let the logging thread deliver the pending readings and terminate
+	 */
+	void drain() {
+		_buffer->lock();
+		_draining = true;
+		pthread_cond_broadcast(&condition);
+		_buffer->unlock();
+	}
+	const bool draining() const { return _draining; }
+
 	void cancel() { if(running()) pthread_cancel(_thread); }
 	
 	const bool running() const { return _thread_running; }
@@ -67,6 +90,12 @@ class Channel {
 	const char* uuid()                  { return _uuid.c_str(); }
 	const std::string apiProtocol()     { return _apiProtocol; }
 
+	/**
+	 * The configuration of the channel, to detect changes on reload
+	 */
+	const std::string &config() const   { return _config; }
+	void config(const std::string &v)   { _config = v; }
+
 	void last(Reading *rd)              { _last = rd;}
 	void push(const Reading &rd)        { _buffer->push(rd); }
 	char *dump(char *dump, size_t len)  { return _buffer->dump(dump, len); }
@@ -82,7 +111,7 @@ class Channel {
 	}
 	inline void wait() {
 		_buffer->lock();
-		while(!_buffer->newValues() ) {
+		while(!_buffer->newValues() && !_draining) {
 			_buffer->wait(&condition); /* sleep until new data has been read */
 		}
 		_buffer->clear_newValues();
@@ -92,6 +121,7 @@ class Channel {
 	private:
 	static int instances;
 	bool _thread_running;   /**< flag if thread is started */
+	bool _draining;         /**< flag if the logging thread should terminate */
 	
 	int id;		       		  /**< only for internal usage & debugging */
 	std::string _name;    /**< name of the channel */
@@ -107,6 +137,7 @@ class Channel {
 
 	std::string _uuid;		   	 /**< unique identifier for middleware */
 	std::string _apiProtocol;  /**< protocol of api to use for logging */
+	std::string _config;       /**< configuration as json string */
 };
 
 #endif /* _CHANNEL_H_ */
@@ -0,0 +1,112 @@
+/**
+ * Source of time for readings and periodic sleeps
+ *
+ * @package vzlogger
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @license http://www.gnu.org/licenses/gpl.txt GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CLOCK_H_
+#define _CLOCK_H_
+
+#include <time.h>
+#include <sys/time.h>
+
+namespace vz {
+	/**
+	 * Wall clock, or a virtual clock in time-warp mode
+	 *
+	 * In time-warp mode every thread runs on its own virtual clock starting at
+	 * the same instant. It only advances when the thread sleeps, so sleeps
+	 * return immediately and a long period of readings is replayed as fast as
+	 * the pipeline can consume it.
+	 */
+	class Clock {
+	public:
+		/**
+		 * Enable time-warp mode
+		 *
+		 * @param duration virtual seconds after which expired() becomes true
+		 */
+		static void warp(double duration);
+		static bool warped() { return _warp; }
+
+		/**
+		 * Current time of the calling thread
+		 */
+		static void gettimeofday(struct timeval *tv);
+		static double now();
+		static time_t time() { return (time_t) now(); }
+
+		/**
+		 * Sleep or advance the virtual clock of the calling thread
+		 */
+		static void sleep(double seconds);
+
+		/**
+		 * Sleep or advance the virtual clock of the calling thread until an absolute time
+		 *
+		 * @param deadline seconds since the epoch
+		 */
+		static void sleep_until(double deadline);
+
+		/**
+		 * @return true if the virtual clock of the calling thread has passed the end of the warp
+		 */
+		static bool expired();
+
+	private:
+		static bool _warp;
+		static double _start;
+		static double _end;
+		static __thread double _now;	/* virtual time of the calling thread, 0 until first use */
+	};
+
+	/**
+	 * Periodic deadlines on a fixed grid
+	 *
+	 * The deadlines are absolute, so the time spent between two waits does
+	 * not add up to a drift. Deadlines which already passed are skipped
+	 * instead of being caught up in a burst.
+	 */
+	class Timer {
+	public:
+		/**
+		 * @param period seconds between two deadlines
+		 * @param align place the deadlines on multiples of the period since
+		 *        the epoch, e.g. at :00, :15, :30 and :45 for 900 seconds
+		 */
+		Timer(double period, bool align);
+
+		/**
+		 * Wait for the next deadline
+		 *
+		 * @return number of deadlines skipped because the caller was late
+		 */
+		unsigned long wait();
+
+	private:
+		double _period;
+		bool _align;
+		double _origin;	/* time of the first deadline, 0 before the first wait */
+		unsigned long long _tick;	/* deadlines since the origin */
+	};
+} // namespace vz
+
+#endif /* _CLOCK_H_ */
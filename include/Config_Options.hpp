@@ -67,6 +67,7 @@ public:
 	const int &comet_timeout() const { return _comet_timeout; }
 	const int &buffer_length() const { return _buffer_length; }
 	const int retry_pause() const { return _retry_pause; }
+	const int shutdown_timeout() const { return _shutdown_timeout; }
 
 	const bool channel_index() const { return _channel_index; }
 	const bool daemon()    const { return _daemon; }
@@ -99,6 +100,7 @@ private:
 	int _comet_timeout;	/* in seconds;  */
 	int _buffer_length;	/* in seconds; how long to buffer readings for local interfalce */
 	int _retry_pause;	/* in seconds; how long to pause after an unsuccessful HTTP request */
+	int _shutdown_timeout;	/* in seconds; how long to deliver pending readings when terminating */
 
 	/* boolean bitfields, padding at the end of struct */
 	int _channel_index:1;	/* give a index of all available channels via local interface */
@@ -128,5 +130,18 @@ private:
  */
 int config_validate_uuid(const char *uuid);
 
+typedef struct {
+	const char *key;
+	Option::type_t type;
+} config_schema_t;
+
+/**
+ * Check the types of known options
+ *
+ * @param schema list of known options, terminated by a NULL key
+ * @throw vz::InvalidTypeException
+ */
+void config_validate(const std::list<Option> &options, const config_schema_t *schema);
+
 
 #endif /* _CONFIG_H_ */
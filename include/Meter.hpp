@@ -27,6 +27,8 @@
 #define _METER_H_
 #include <list>
 #include <vector>
+#include <time.h>
+#include <pthread.h>
 
 #include <Reading.hpp>
 #include <Options.hpp>
@@ -35,6 +37,8 @@
 #include <meter_protocol.hpp>
 #include <protocols/Protocol.hpp>
 
+#define METER_RETRY_MAX 300 /* max. delay between two attempts to open a meter [s] */
+
 class Meter {
 
 public:
@@ -44,23 +48,36 @@ public:
 //	Meter(const Meter *mtr);
 	virtual ~Meter();
 
+	/**
+	 * Open the protocol, unless it is already open
+	 *
+	 * @throws vz::ConnectionException if the meter cannot be reached
+	 */
 	void open();
 	int close();
 	size_t read(std::vector<Reading> &rds, size_t n);
 
 // setter
-	void interval(const int i) { _interval = i; }
+	void interval(const double i) { _interval = i; }
 
 // getter
 	const char *name() const               { return _name.c_str(); }
 	const bool isEnabled() const           { return _enable; }
+	const bool isOpen() const;
 
 	const meter_protocol_t protocolId() const { return _protocol_id; } 
 	vz::protocol::Protocol::Ptr protocol() { return _protocol; }
 
 	ReadingIdentifier::Ptr identifier()    { return _identifier; }
 
-	const int  interval() const            { return _interval; }
+	const double interval() const          { return _interval; }
+	const bool align() const               { return _align; }
+	const double watchdog() const          { return _watchdog; }
+
+	/**
+	 * @return seconds since the meter delivered readings or has been opened
+	 */
+	double stale() const;
 
 private:
 	static int instances;                   /**< meter instance id (increasing counter) */
@@ -69,6 +86,7 @@ private:
 	int id;                                 /**< meter id */
 	std::string _name;                      /**< meter name */
 	bool _enable;                           /**< true if meter is disabled (default) */
+	bool _open;                             /**< true once the protocol has been opened */
 
 	meter_protocol_t _protocol_id;          /**< meter protocol id */
 	vz::protocol::Protocol::Ptr _protocol;  /**< meter protocol */
@@ -76,7 +94,24 @@ private:
 	ReadingIdentifier::Ptr _identifier;
 
 
-	int _interval;
+	double _interval;                       /**< seconds between two readings, millisecond resolution */
+	bool _align;                            /**< align the readings to multiples of the interval */
+	double _watchdog;                       /**< seconds without readings before the meter is reset, 0 to disable */
+	double _fresh;                          /**< monotonic time of the last readings */
+	mutable pthread_mutex_t _mutex;         /**< guards _open and _fresh, read by the watchdog */
+
+	/**
+	 * Log the throughput of the protocol if the statistics interval has passed
+	 */
+	void _report();
+
+	int _stats_interval;                    /**< seconds between two throughput reports, 0 to disable */
+	struct timespec _stats_time;            /**< time of the last report */
+	vz::protocol::Protocol::stats_t _stats; /**< protocol counters at the last report */
+	double _cpu;                            /**< cpu time spent in read() */
+	double _stats_cpu;                      /**< _cpu at the last report */
+	unsigned long long _readings;           /**< readings returned by read() */
+	unsigned long long _stats_readings;     /**< _readings at the last report */
 
 	std::vector<Channel> channels;          /**< channel for logging */
 };
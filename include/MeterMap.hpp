@@ -38,6 +38,8 @@
 #define _MeterMap_hpp_
 #include <pthread.h>
 #include <vector>
+#include <list>
+#include <string>
 
 #include <common.h>
 #include <Options.hpp>
@@ -53,24 +55,57 @@ public:
 	typedef std::vector<Channel::Ptr>::iterator iterator;
 	typedef std::vector<Channel::Ptr>::const_iterator const_iterator;
 
-	MeterMap(std::list<Option> options) : _meter(new Meter(options)){}
+	MeterMap(std::list<Option> options, const std::string &config = "")
+		: _meter(new Meter(options)), _config(config), _notify(-1), _reader(false), _reading(false), _stalled(false) {}
 	~MeterMap() {};
 	Meter::Ptr meter() { return _meter; }
 
+/**
+	 The configuration of the meter without its channels, to detect changes on reload
+*/
+	const std::string &config() const { return _config; }
+
 /**
 	 If the meter is enabled, start the meter and all its channels.
+
+	 @param notify a byte is written to this descriptor when the reading thread terminates
 */
-	void start();
+	void start(int notify = -1);
 
 /**
-	 check if meter-thread is joinable
+	 Called by the reading thread when it terminates
 */
-	bool stopped();
+	void finished();
+
+/**
+ * cancel the reading thread, the channels keep running
+ */
+	void stop();
+
+/**
+ * let the channels deliver their pending readings and wait for them
+ *
+ * @param deadline absolute time on CLOCK_REALTIME, channels still busy are cancelled
+ */
+	void drain(const struct timespec &deadline);
 
 /**
- * cancel all channels for this meter.
+ * take over the channels of a reloaded configuration of the same meter
+ *
+ * Unchanged channels keep running with their buffers. The reading thread
+ * is only paused if channels have been added or removed, the meter stays open.
+ *
+ * @param deadline absolute time on CLOCK_REALTIME for removed channels to deliver their readings
  */
-	void cancel();
+	void update(MeterMap &other, const struct timespec &deadline);
+
+/**
+ * check that the meter delivered readings within its watchdog time
+ *
+ * A stalled meter is reported. If it stays stalled for twice the watchdog
+ * time although it is open, the reading thread is stuck and gets restarted.
+ */
+	void watchdog();
 
 /**
  * send device-registration for each channel
@@ -86,13 +121,23 @@ public:
 	inline size_t size()     { return _channels.size(); }
 
 	const bool running() const { return _thread_running; }
+	const bool reading() const { return _reading; }
 
 private:
+	void _start_reader();
+	void _start_channel(Channel::Ptr ch);
+	void _join_channel(Channel::Ptr ch, const struct timespec &deadline);
+
 	Meter::Ptr _meter;
 	std::vector<Channel::Ptr> _channels;
+	std::string _config;    /**< configuration of the meter, see config() */
 
 	bool _thread_running = false;   /**< flag if thread is started */
 	pthread_t _thread;      /**< Thread data for meter (reading) */
+	int _notify;            /**< descriptor to signal the termination of the reading thread */
+	bool _reader;           /**< reading thread has been created and not yet joined */
+	bool _reading;          /**< reading thread has not yet terminated */
+	bool _stalled;          /**< no readings within the watchdog time */
 };
 
 /**
@@ -101,20 +146,58 @@ private:
 class MapContainer {
 public:
 	typedef vz::shared_ptr<MapContainer> Ptr;
-	typedef std::vector<MeterMap>::iterator iterator;
-	typedef std::vector<MeterMap>::const_iterator const_iterator;
+	typedef std::list<MeterMap>::iterator iterator;
+	typedef std::list<MeterMap>::const_iterator const_iterator;
 
-	MapContainer() {};
-	~MapContainer() {};
+	MapContainer() { _finished[0] = _finished[1] = -1; pthread_mutex_init(&_mutex, NULL); };
+	~MapContainer();
 
-	void quit(int sig) {
-        print(log_debug, "terminating on signal %d.", (char*)0, sig);
-		print(log_info, "Closing connections to terminate", (char*)0);
+/**
+ * start all enabled meters
+ */
+	void start();
 
-		for(iterator it = _mappings.begin(); it!=_mappings.end(); it++) {
-			it->cancel();
-		}
-	}
+/**
+ * @return number of reading threads which have not yet terminated
+ */
+	size_t reading() const;
+
+/**
+ * readable whenever a reading thread terminated, one byte per thread
+ */
+	int finished() const { return _finished[0]; }
+
+/**
+ * stop all readers and deliver the pending readings
+ *
+ * @param timeout seconds to wait for the delivery before the channels are cancelled
+ */
+	void shutdown(int timeout);
+
+/**
+ * check the watchdog of all meters
+ *
+ * @return true if any meter is watched
+ */
+	bool watchdog();
+
+/**
+ * apply a reloaded configuration
+ *
+ * Meters with an unchanged configuration keep running and take over the
+ * channels of the new configuration. Removed and changed meters are
+ * stopped and deliver their pending readings before the new ones are started.
+ *
+ * @param fresh the new configuration, its mappings are moved into this container
+ * @param timeout seconds for stopped channels to deliver their readings
+ */
+	void reload(MapContainer &fresh, int timeout);
+
+/**
+ * held while the mappings are changed by reload()
+ */
+	void lock()   { pthread_mutex_lock(&_mutex); }
+	void unlock() { pthread_mutex_unlock(&_mutex); }
 
 /** 
  *  Accessor to the MeterMap (meter and its channels) list
@@ -125,7 +208,9 @@ public:
 	inline const size_t size() const { return _mappings.size(); }
 
 private:
-	std::vector<MeterMap> _mappings;
+	std::list<MeterMap> _mappings;
+	int _finished[2];	/**< pipe signalling terminated reading threads */
+	pthread_mutex_t _mutex;
 
 };
 #endif /* _MeterMap_hpp_ */
@@ -13,6 +13,17 @@ struct addressparam
 	unsigned char function_code;
 	unsigned int address;
 	const char *recalc_str;
+	int slave;	/* modbus slave id, -1 if not specified */
+	int period;	/* poll period in seconds, 0 to poll at every interval */
+	const char *type;	/* register type like "float32:cdab", NULL for uint16 */
+};
+
+struct inputparam
+{
+	const char *device;	/* NULL terminates the list */
+	const char *name;
+	int resolution;	/* -1 if not specified */
+	int debounce;	/* -1 if not specified */
 };
 
 class Option {
@@ -43,12 +54,13 @@ public:
 
 	virtual ~Option();
 
-	const std::string key() const { return _key; }
+	const std::string &key() const { return _key; }
 	operator const char *() const;
 	operator int() const;
 	operator double() const;
 	operator bool() const;
 	operator struct addressparam *() const;
+	operator struct inputparam *() const;
 
 	const type_t type() const { return _type; }
 
@@ -80,6 +92,7 @@ private:
 		double floating;
 		int boolean:1;
 		struct addressparam *addressparams;
+		struct inputparam *inputparams;
 	} value;
 
 };
@@ -97,13 +110,32 @@ public:
 	typedef std::list<Option>::iterator iterator;
 	typedef std::list<Option>::const_iterator const_iterator;
 
-	const Option& lookup(std::list<Option> options, const std::string &key);
-	const char  *lookup_string(std::list<Option> options, const char *key);
-	const int    lookup_int(std::list<Option> options, const char *key);
-	const bool   lookup_bool(std::list<Option> options, const char *key);
-	const double lookup_double(std::list<Option> options, const char *key);
-	const struct addressparam *lookup_addressparams(std::list<Option> options, const char *key);
-	void dump(std::list<Option> options);
+	const Option& lookup(const std::list<Option> &options, const std::string &key);
+	const char  *lookup_string(const std::list<Option> &options, const char *key);
+	const int    lookup_int(const std::list<Option> &options, const char *key);
+	const bool   lookup_bool(const std::list<Option> &options, const char *key);
+	const double lookup_double(const std::list<Option> &options, const char *key);
+
+	/**
+	 * Lookup an optional option
+	 *
+	 * @return NULL if the option is not set
+	 */
+	const Option *find(const std::list<Option> &options, const char *key);
+
+	/**
+	 * Lookup optional options without throwing if they are not set
+	 *
+	 * @param fallback returned if the option is not set
+	 * @throw vz::InvalidTypeException if the option has another type
+	 */
+	const char  *lookup_string(const std::list<Option> &options, const char *key, const char *fallback);
+	const int    lookup_int(const std::list<Option> &options, const char *key, int fallback);
+	const bool   lookup_bool(const std::list<Option> &options, const char *key, bool fallback);
+	const double lookup_double(const std::list<Option> &options, const char *key, double fallback);
+	const struct addressparam *lookup_addressparams(const std::list<Option> &options, const char *key);
+	const struct inputparam *lookup_inputparams(const std::list<Option> &options, const char *key);
+	void dump(const std::list<Option> &options);
 
 	void parse();
 
@@ -34,6 +34,7 @@
 
 #include "Obis.hpp"
 #include <shared_ptr.hpp>
+#include <Clock.hpp>
 #include <meter_protocol.hpp>
 
 #define MAX_IDENTIFIER_LEN 255
@@ -42,6 +43,16 @@
 class ReadingIdentifier {
 public:
 	typedef vz::shared_ptr<ReadingIdentifier> Ptr;
+
+	/* kind of identifier, avoids RTTI when comparing identifiers for every reading */
+	typedef enum {
+		type_nil,
+		type_obis,
+		type_string,
+		type_channel,
+		type_address
+	} type_t;
+
 	virtual ~ReadingIdentifier(){};
 
 	virtual size_t unparse(char *buffer, size_t n) = 0;
@@ -50,8 +61,12 @@ public:
 
 	virtual const std::string toString()  = 0;
 
+	const type_t type() const { return _type; }
+
 protected:
-	explicit ReadingIdentifier() {};
+	explicit ReadingIdentifier(type_t type) : _type(type) {};
+
+	const type_t _type;
 
 private:
 //ReadingIdentifier (const ReadingIdentifier& original);
@@ -63,8 +78,8 @@ class ObisIdentifier : public ReadingIdentifier {
 public:
 	typedef vz::shared_ptr<ObisIdentifier> Ptr;
 
-	ObisIdentifier() {}
-	ObisIdentifier(Obis obis) : _obis(obis) {}
+	ObisIdentifier() : ReadingIdentifier(type_obis) {}
+	ObisIdentifier(Obis obis) : ReadingIdentifier(type_obis), _obis(obis) {}
 	virtual ~ObisIdentifier(){};
 
 	size_t unparse(char *buffer, size_t n);
@@ -87,8 +102,8 @@ protected:
 
 class StringIdentifier : public ReadingIdentifier {
 public:
-	StringIdentifier() {}
-	StringIdentifier(std::string s) : _string(s) {}
+	StringIdentifier() : ReadingIdentifier(type_string) {}
+	StringIdentifier(std::string s) : ReadingIdentifier(type_string), _string(s) {}
 
 	void parse(const char *buffer);
 	size_t unparse(char *buffer, size_t n);
@@ -106,8 +121,8 @@ protected:
 class ChannelIdentifier : public ReadingIdentifier {
 
 public:
-	ChannelIdentifier() {}
-	ChannelIdentifier(int channel) : _channel(channel) {}
+	ChannelIdentifier() : ReadingIdentifier(type_channel) {}
+	ChannelIdentifier(int channel) : ReadingIdentifier(type_channel), _channel(channel) {}
 
 	void parse(const char *string);
 	size_t unparse(char *buffer, size_t n);
@@ -124,7 +139,7 @@ protected:
 
 class NilIdentifier : public ReadingIdentifier {
 public:
-	NilIdentifier() {}
+	NilIdentifier() : ReadingIdentifier(type_nil) {}
 	size_t unparse(char *buffer, size_t n);
 	bool operator==(NilIdentifier &cmp);
 	const std::string toString()  {
@@ -138,8 +153,8 @@ private:
 class AddressIdentifier : public ReadingIdentifier {
 
 public:
-	AddressIdentifier() {}
-	AddressIdentifier(unsigned int address) : _address(address) {}
+	AddressIdentifier() : ReadingIdentifier(type_address), _address(0), _slave(0) {}
+	AddressIdentifier(unsigned int address, unsigned int slave = 0) : ReadingIdentifier(type_address), _address(address), _slave(slave) {}
 	AddressIdentifier(const char *string);
 	
 	void parse(const char *string);
@@ -153,6 +168,7 @@ public:
 
 protected:
 	unsigned int _address;
+	unsigned int _slave;	/* modbus slave id, 0 if not specified */
 };
 
 class Reading {
@@ -173,11 +189,12 @@ public:
 
 	const  double tvtod() const;
 	double tvtod(struct timeval tv);
-	void time() { gettimeofday(&_time, NULL); }
+	void time() { vz::Clock::gettimeofday(&_time); }
 	void time(struct timeval &v) { _time = v; }
 	struct timeval dtotv(double ts);
 
 	void identifier(ReadingIdentifier *rid)  { _identifier.reset(rid); }
+	void identifier(const ReadingIdentifier::Ptr &rid) { _identifier = rid; }
 	const ReadingIdentifier::Ptr identifier() { return _identifier; }
 
 /**
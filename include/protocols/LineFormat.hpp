@@ -0,0 +1,109 @@
+/**
+ * Precompiled line formats for text based protocols
+ *
+ * @package vzlogger
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @license http://www.gnu.org/licenses/gpl.txt GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LINE_FORMAT_H_
+#define _LINE_FORMAT_H_
+
+#include <string>
+#include <vector>
+
+#include <Reading.hpp>
+
+/**
+ * A format string like "$i $v $t" compiled into a small token program
+ *
+ * The tokens are replaced as follows:
+ *  "$v" => value (floating point)
+ *  "$i" => identifier (string without whitespaces)
+ *  "$t" => timestamp (floating point unix time)
+ *
+ * Whitespaces in the format match any amount of whitespaces in the line,
+ * all other characters have to match literally (like scanf() does).
+ */
+class LineFormat {
+
+public:
+	LineFormat();
+
+	/**
+	 * Compile the format string into the token program
+	 *
+	 * @param format the format string, NULL or "" is the same as "$v"
+	 * @throw vz::VZException if the format does not contain "$v"
+	 */
+	void compile(const char *format);
+
+	/**
+	 * Parse a single line into a reading
+	 *
+	 * Identifiers are interned: equal strings share the same identifier object,
+	 * so the hot path does not allocate any memory.
+	 *
+	 * @param line zero terminated line without trailing newline
+	 * @param rd the reading to store to
+	 * @return true if at least the value could be parsed
+	 */
+	bool parse(const char *line, Reading &rd);
+
+	const std::string &format() const { return _format; }
+
+	/**
+	 * Fast conversion of a decimal floating point number
+	 *
+	 * @param str the string to parse, leading whitespaces are not skipped
+	 * @param end pointer to the first character after the number
+	 * @return the value, undefined if end == str
+	 */
+	static double parse_double(const char *str, const char **end);
+
+private:
+	typedef enum {
+		op_literal,     /**< match _literals[arg] literally */
+		op_space,       /**< skip any amount of whitespaces */
+		op_value,
+		op_identifier,
+		op_timestamp
+	} opcode_t;
+
+	typedef struct {
+		opcode_t op;
+		size_t arg;
+	} token_t;
+
+	typedef struct {
+		unsigned int hash;
+		std::string str;
+		ReadingIdentifier::Ptr id;
+	} intern_t;
+
+	ReadingIdentifier::Ptr _intern(const char *str, size_t len);
+
+	std::string _format;
+	std::vector<token_t> _program;
+	std::vector<std::string> _literals;
+	std::vector<intern_t> _identifiers;  /**< interned identifiers */
+	ReadingIdentifier::Ptr _default_id;  /**< used if the format has no "$i" */
+};
+
+#endif /* _LINE_FORMAT_H_ */
@@ -51,18 +51,12 @@ private:
 	std::string _host;
 	std::string _device;
 	int _baudrate;
+	int _timeout; /* connect timeout [ms] */
 
 	int _fd; /* file descriptor of port */
+	bool _tty; /* false for pipes, fifos and files which need no serial setup */
 	struct termios _oldtio; /* required to reset port */
 
-	/**
-	 * Open socket
-	 *
-	 * @param node the hostname or ASCII encoded IP address
-	 * @param the ASCII encoded portnum or service as in /etc/services
-	 * @return file descriptor, <0 on error
-	 */
-	int _openSocket(const char *node, const char *service);
 	int _openDevice(struct termios *old_tio, speed_t baudrate);
 };
 
@@ -26,7 +26,13 @@
 #ifndef _EXEC_H_
 #define _EXEC_H_
 
+#include <sys/types.h>
+
 #include <protocols/Protocol.hpp>
+#include <protocols/LineFormat.hpp>
+
+#define EXEC_BUFFER_LEN 4096
+#define EXEC_KILL_TIMEOUT 2000 /* ms to wait for the program to terminate before it is killed */
 
 class MeterExec : public vz::protocol::Protocol {
 
@@ -38,9 +44,48 @@ public:
 	int close();
 	ssize_t read(std::vector<Reading> &rds, size_t n);
 
+	const char *command() const { return _command.c_str(); }
+
   private:
-	const char *_command;
-	const char *_format;
+	/**
+	 * Start the command with its stdout connected to _fd
+	 *
+	 * @return SUCCESS or ERR
+	 */
+	int _spawn();
+
+	/**
+	 * Terminate and reap the child process
+	 *
+	 * @param sig signal to send, 0 to wait for a voluntary exit
+	 */
+	void _reap(int sig);
+
+	/**
+	 * Parse all complete lines in the receive buffer
+	 *
+	 * @return number of readings stored in rds starting at index i
+	 */
+	size_t _parse_lines(std::vector<Reading> &rds, size_t i, size_t n);
+
+	/**
+	 * Read from the pipe into the receive buffer, sets _eof on end of file and on errors
+	 *
+	 * @param timeout poll() timeout in ms, -1 to block
+	 * @return bytes read, 0 on EOF or timeout, <0 on error
+	 */
+	ssize_t _fill(int timeout);
+
+	std::string _command;
+	LineFormat _format;
+	bool _persistent;   /**< keep the program running and stream its output */
+
+	pid_t _pid;         /**< pid of the running program, 0 if none */
+	int _fd;            /**< read end of the stdout pipe */
+	bool _eof;
+
+	char _buffer[EXEC_BUFFER_LEN];
+	size_t _len;        /**< bytes in _buffer */
 };
 
 #endif /* _EXEC_H_ */
@@ -27,6 +27,7 @@
 #define _FILE_H_
 
 #include <protocols/Protocol.hpp>
+#include <protocols/LineFormat.hpp>
 
 class MeterFile : public vz::protocol::Protocol {
 
@@ -39,11 +40,11 @@ public:
 	ssize_t read(std::vector<Reading> &rds, size_t n);
 
 	const char *path() { return _path.c_str(); }
-	const char *format() { return _format.c_str(); }
+	const char *format() { return _format.format().c_str(); }
   
   private:
 	std::string _path;
-	std::string _format;
+	LineFormat _format;   /**< compiled format string */
 	int _rewind;
 
 	FILE *_fd;
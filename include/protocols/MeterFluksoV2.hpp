@@ -42,7 +42,7 @@ public:
 	ssize_t _read_line(int fd, char  *buffer, size_t n);
   
   private:
-	const char *_fifo;
+	std::string _fifo;
 	int _fd;	/* file descriptor of fifo */
 
 	//const char *DEFAULT_FIFO = "/var/run/spid/delta/out";
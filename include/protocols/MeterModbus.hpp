@@ -26,8 +26,13 @@
 #ifndef _MMODBUS_H_
 #define _MMODBUS_H_
 
+#include <vector>
+#include <map>
+
 #include <protocols/Protocol.hpp>
 #include "Options.hpp"
+#include <protocols/expression_parser.hpp>
+#include <protocols/ModbusConnection.hpp>
 #include <modbus.h>
 
 #define READ_COIL_STATUS 1
@@ -35,6 +40,10 @@
 #define READ_HOLDING_REGISTERS 3
 #define READ_INPUT_REGISTERS 4
 
+#define MODBUS_DEFAULT_MAX_GAP 0 /* only coalesce adjacent addresses by default */
+#define MODBUS_DEFAULT_TIMEOUT 500 /* response timeout [ms] */
+#define MODBUS_DEFAULT_BACKOFF 60 /* max. time to skip an unresponsive slave [s] */
+
 class MeterModbus : public vz::protocol::Protocol {
 
 public:
@@ -45,17 +54,137 @@ public:
 	int close();
 	ssize_t read(std::vector<Reading> &rds, size_t n);
 	const char *ip() { return _ip.c_str(); }
+	const char *device() { return _device.c_str(); }
   
   private:
-	modbus_t *_mb;
+	ModbusConnection::Ptr _connection;	/* shared with meters on the same gateway/line */
 	std::string _ip;
 	int _port;
+
+	/* RTU transport, used if a device is given */
+	std::string _device;
+	int _baudrate;
+	char _parity;
+	int _databits;
+	int _stopbits;
+
+	int _slave;	/* default slave id */
+	int _timeout;	/* response timeout [ms] */
+	int _backoff;	/* max. time to skip an unresponsive slave [s] */
+	int _pipeline;	/* max. number of outstanding requests (TCP only) */
 	int _address;
 	int _length;
 	bool _input_read;
-	bool _reset_connection = true;
 	struct addressparam *_addressparams;
+	int _max_gap;	/* max. number of unused addresses read to merge two requests */
+
+	typedef enum {
+		type_uint,
+		type_int,
+		type_float
+	} type_t;
+
+	typedef struct {
+		const struct addressparam *param;
+		const expression_program *program;	/* compiled recalc_str */
+		int slave;
+		int offset;	/* zero based protocol address */
+		int period;	/* poll every n-th tick */
+		int width;	/* number of registers */
+		type_t type;
+		bool word_swap;	/* least significant word first */
+		bool byte_swap;	/* least significant byte first within words */
+		unsigned long next;	/* tick at which the address is due again */
+	} reg_t;
+
+	/**
+	 * Addresses of the same slave and function code fetched by a single request
+	 */
+	typedef struct {
+		int slave;
+		int function_code;
+		int start;	/* offset of the first register/bit */
+		int count;	/* number of registers/bits to read */
+		std::vector<reg_t *> registers;
+		std::vector<uint16_t> regs;	/* response buffer */
+		std::vector<uint8_t> bits;
+	} block_t;
+
+	std::vector<reg_t> _registers;	/* sorted by slave, function code and offset */
+	std::vector<block_t> _blocks;	/* requests of the current tick */
+	unsigned long _tick;	/* number of polls */
+	size_t _scheduled;	/* number of addresses in _blocks */
+	double _interval;	/* interval of the meter [s] */
+	std::vector<expression_program> _programs;	/* one per address */
+
+	/**
+	 * Scheduling state of a slave on the bus
+	 */
+	typedef struct {
+		int failures;	/* consecutive failed requests */
+		struct timeval retry;	/* skip the slave until then */
+	} slave_t;
+
+	std::map<int, slave_t> _slaves;
+
+	/**
+	 * Poll counters, summarized every _stats_interval seconds
+	 */
+	typedef struct {
+		unsigned long polls;
+		unsigned long requests;	/* including fallback requests */
+		unsigned long long tx;	/* bytes sent, estimated from the frame sizes */
+		unsigned long long rx;	/* bytes received */
+		double latency;	/* sum of the poll latencies [s] */
+		double latency_max;
+		double wait;	/* sum of the time spent queueing for the connection [s] */
+	} poll_stats_t;
+
+	int _stats_interval;	/* seconds between two poll reports, 0 to disable */
+	struct timespec _stats_time;	/* time of the last report */
+	poll_stats_t _poll_stats;
+
 	void getHighestDigit(unsigned int number, unsigned char *digit, unsigned char *power);
+
+	/**
+	 * Compile the expressions and sort the configured addresses
+	 */
+	void _prepare();
+
+	/**
+	 * Group the addresses due at the current tick into blocks
+	 * respecting the protocols limits for a single request
+	 */
+	void _schedule();
+	static bool _compare(const reg_t &a, const reg_t &b);
+	int _offset(const struct addressparam *param);
+	/**
+	 * Parse a register type like "int32", "float32:cdab" or "uint64:dcba"
+	 */
+	void _type(const struct addressparam *param, reg_t &reg);
+
+	/**
+	 * Decode a typed value from a response
+	 *
+	 * @param regs the registers of the value
+	 */
+	static double _decode(const reg_t &reg, const uint16_t *regs);
+	bool _store(const reg_t &reg, double value, Reading &rd);
+
+	/**
+	 * Skip an unresponsive slave for an exponentially growing time
+	 */
+	void _fail(int slave, const struct timeval &now);
+
+	/**
+	 * Account the requests of a transfer in the protocol and poll counters
+	 */
+	void _account(const std::vector<ModbusConnection::request_t> &requests);
+
+	/**
+	 * Log the poll counters once the statistics interval elapsed
+	 */
+	void _report();
 };
 
 #endif /* _FILE_H_ */
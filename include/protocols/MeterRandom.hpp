@@ -26,6 +26,9 @@
 #ifndef _RANDOM_H_
 #define _RANDOM_H_
 
+#include <stdint.h>
+#include <vector>
+
 #include <protocols/Protocol.hpp>
 
 double ltqnorm(double p); /* forward declaration */
@@ -41,9 +44,41 @@ public:
 	ssize_t read(std::vector<Reading> &rds, size_t n);
 
 protected:
+	typedef enum {
+		model_walk,	/* random walk between min and max */
+		model_counter,	/* monotonic counter, incremented by one per reading */
+		model_step	/* alternates between min and max every period readings */
+	} model_t;
+
+	/**
+	 * Uniformly distributed pseudo random number from our own generator
+	 *
+	 * @return number in (0, 1)
+	 */
+	double _uniform();
+
+	/**
+	 * Advance the model of an identifier
+	 *
+	 * @return new value
+	 */
+	double _next(size_t id);
+
 	double _min;
 	double _max;
-	double _last;
+	model_t _model;
+	int _period;
+	double _rate;	/* readings per second, 0 for one reading per identifier and read() */
+	uint64_t _seed;
+	uint64_t _state;	/* xorshift64* state */
+
+	std::vector<ReadingIdentifier::Ptr> _ids;
+	std::vector<double> _values;	/* last value per identifier */
+	std::vector<unsigned long> _steps;	/* readings per identifier */
+	size_t _current;	/* next identifier */
+
+	double _start;	/* time of open() */
+	unsigned long long _emitted;	/* readings since open() */
 };
 
 #endif /* _RANDOM_H_ */
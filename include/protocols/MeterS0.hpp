@@ -27,9 +27,16 @@
 #define _S0_H_
 
 #include <termios.h>
+#include <pthread.h>
+
+#include <string>
+#include <vector>
 
 #include <protocols/Protocol.hpp>
 
+#define S0_WINDOW_LEN 256 /* max. number of pulses used to derive the power */
+#define S0_MAX_INPUTS 16
+
 class MeterS0 : public vz::protocol::Protocol {
 
 public:
@@ -41,16 +48,71 @@ public:
 	ssize_t read(std::vector<Reading> &rds, size_t n);
 
   private:
-	int _open_socket(const char *node, const char *service);
-	int _open_device(struct termios *old_tio, speed_t baudrate);
+	typedef struct {
+		std::string device;
+		std::string name;	/* prefix for the identifiers, empty for a single input */
+		int resolution;
+		double debounce;	/* min. time between two pulses in seconds */
+
+		int fd;	/* file descriptor of port */
+		bool tty;	/* false for pipes and fifos which need no serial setup */
+		struct termios old_tio;	/* required to reset port */
+		double wakeup;	/* monotonic time of the last wakeup */
+		bool active;	/* false after a read error */
+
+		unsigned long long counter;	/* pulses since start, kept across reopening */
+		unsigned long long reported;	/* counter at the last read() */
+		double last_real;	/* wall clock time of the last pulse */
+		double pulses[S0_WINDOW_LEN];	/* monotonic times of the last pulses */
+		size_t head;
+	} input_t;
+
+	int _open_device(input_t &input);
+	void _close_device(input_t &input);
+
+	/**
+	 * Pulse engine: wait for characters on all ports and count them as pulses
+	 * until woken up by close()
+	 */
+	static void *_engine(void *arg);
+	void _run();
+
+	/**
+	 * Receive pending characters of an input, _mutex has to be held
+	 *
+	 * @return false if the input failed
+	 */
+	bool _receive(input_t &input, double mono, double real);
+
+	/**
+	 * Account a single pulse, _mutex has to be held
+	 *
+	 * @param mono monotonic time of the pulse in seconds
+	 * @param real wall clock time of the pulse in seconds
+	 */
+	void _pulse(input_t &input, double mono, double real);
+
+	/**
+	 * Derive the power from the pulses inside the sliding window, _mutex has to be held
+	 *
+	 * @param now current monotonic time in seconds
+	 * @return power in W, negative if there are not enough pulses yet
+	 */
+	double _power(const input_t &input, double now) const;
+
+	bool _pending() const;
 
   protected:
-	const char *_device;
-	int _resolution;
-	int _counter;
+	std::vector<input_t> _inputs;
+	double _interval;
+	double _window;		/* length of the sliding window in seconds */
+
+	int _wakeup[2];	/* self-pipe to stop the engine */
 
-	int _fd;	/* file descriptor of port */
-	struct termios _old_tio;	/* required to reset port */
+	pthread_t _thread;
+	pthread_mutex_t _mutex;
+	pthread_cond_t _cond;	/* signaled on every pulse */
+	bool _running;
 };
 
 #endif /* _S0_H_ */
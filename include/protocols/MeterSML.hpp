@@ -30,12 +30,10 @@
 #ifndef _SML_H_
 #define _SML_H_
 
-#include <sml/sml_file.h>
-#include <sml/sml_value.h>
-
 #include <termios.h>
 
 #include <protocols/Protocol.hpp>
+#include <protocols/SmlDecoder.hpp>
 #include "Obis.hpp"
 
 class MeterSML : public vz::protocol::Protocol {
@@ -58,19 +56,15 @@ protected:
 	std::string _host;
 	std::string _device;
 	speed_t _baudrate;
+	int _timeout;	/* connect timeout [ms] */
 
 	int _fd;	/* file descriptor of port */
+	bool _tty;	/* false for pipes, fifos and files which need no serial setup */
 	struct termios _old_tio;	/* required to reset port */
 
 	const int BUFFER_LEN;
 
-	/**
-	 * Parses SML list entry and stores it in reading pointed by rd
-	 *
-	 * @param list the list entry
-	 * @param rd the reading to store to
-	 */
-	void _parse(sml_list *list, Reading *rd);
+	SmlDecoder _decoder;	/* walks the received files without allocations */
 
 	/**
 	 * Open serial port by device
@@ -81,15 +75,6 @@ protected:
 	 * @return file descriptor, <0 on error
 	 */
 	int _openDevice(struct termios *old_config, speed_t baudrate);
-
-	/**
-	 * Open socket
-	 *
-	 * @param node the hostname or ASCII encoded IP address
-	 * @param the ASCII encoded portnum or service as in /etc/services
-	 * @return file descriptor, <0 on error
-	 */
-	int _openSocket(const char *node, const char *service);
 };
 
 
@@ -0,0 +1,136 @@
+/**
+ * Connections to modbus gateways and serial lines shared by several meters
+ *
+ * @package vzlogger
+ * @copyright Copyright (c) 2013, The volkszaehler.org project
+ * @license http://www.gnu.org/licenses/gpl.txt GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+ 
+#ifndef _MODBUS_CONNECTION_H_
+#define _MODBUS_CONNECTION_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <shared_ptr.hpp>
+#include <modbus.h>
+
+/**
+ * A modbus connection shared by all meters using the same gateway (ip:port)
+ * or serial device
+ *
+ * Meters queue for the connection in FIFO order and each holds it for a
+ * whole poll. Requests to different unit ids are multiplexed over the single
+ * connection. On TCP, up to "depth" requests can be pipelined.
+ */
+class ModbusConnection {
+
+public:
+	typedef vz::shared_ptr<ModbusConnection> Ptr;
+
+	typedef struct {
+		int slave;
+		int function_code;
+		int start;		/* offset of the first register/bit */
+		int count;		/* number of registers/bits */
+		uint16_t *regs;		/* destination for registers */
+		uint8_t *bits;		/* destination for bits */
+		int rc;			/* number of registers/bits read, -1 on error */
+		int error;		/* errno if rc == -1 */
+	} request_t;
+
+	/**
+	 * Get the connection to a modbus TCP gateway
+	 */
+	static Ptr tcp(const std::string &ip, int port);
+
+	/**
+	 * Get the connection to a modbus RTU serial line
+	 */
+	static Ptr rtu(const std::string &device, int baudrate, char parity, int databits, int stopbits);
+
+	~ModbusConnection();
+
+	const std::string &name() const { return _name; }
+	bool connected() const { return _connected; }
+
+	/**
+	 * Wait in line for exclusive access to the connection
+	 */
+	void lock();
+	void unlock();
+
+	/**
+	 * Connect if not already connected, has to be called with the lock held
+	 *
+	 * @param timeout the response timeout
+	 * @return SUCCESS or ERR
+	 */
+	int connect(const struct timeval &timeout);
+	void disconnect();
+
+	/**
+	 * Execute requests, has to be called with the lock held
+	 *
+	 * Once a slave failed to respond, its remaining requests fail without
+	 * being sent. Connection errors fail all remaining requests and close
+	 * the connection.
+	 *
+	 * @param requests the requests, rc and error are set for each of them
+	 * @param depth max. number of outstanding requests (TCP only)
+	 */
+	void transfer(std::vector<request_t> &requests, int depth);
+
+private:
+	ModbusConnection(const std::string &name);
+	static Ptr _lookup(const std::string &name, bool &created);
+
+	void _sequential(std::vector<request_t> &requests);
+	void _pipelined(std::vector<request_t> &requests, int depth);
+	int _send(int fd, const request_t &req, uint16_t tid);
+	int _recv(int fd, uint8_t *buffer, size_t len);
+	bool _decode(request_t &req, const uint8_t *pdu, size_t len);
+
+	std::string _name;
+	bool _rtu;
+	std::string _host;
+	int _port;
+	int _baudrate;
+	char _parity;
+	int _databits;
+	int _stopbits;
+
+	modbus_t *_mb;
+	bool _connected;
+	struct timeval _timeout;
+	uint16_t _tid;		/* transaction id of pipelined requests */
+
+	pthread_mutex_t _mutex;
+	pthread_cond_t _cond;
+	unsigned long _next;	/* next ticket to hand out */
+	unsigned long _serving;	/* ticket allowed to use the connection */
+
+	static std::map<std::string, vz::weak_ptr<ModbusConnection> > _registry;
+	static pthread_mutex_t _registry_mutex;
+};
+
+#endif /* _MODBUS_CONNECTION_H_ */
@@ -36,13 +36,26 @@
 #include <Reading.hpp>
 #include <Options.hpp>
 
+#define PROTOCOL_CONNECT_TIMEOUT 5000 /* default timeout to connect to remote meters [ms] */
+
 namespace vz {
 	namespace protocol {
 		class Protocol {
 		public:
 			typedef vz::shared_ptr<Protocol> Ptr;
 
-			Protocol(const std::string &name) : _name(name) {};
+			/**
+			 * Throughput counters, maintained by the protocols while receiving
+			 */
+			typedef struct {
+				unsigned long long bytes;       /**< bytes received from the meter */
+				unsigned long long telegrams;   /**< telegrams, frames or lines parsed */
+				unsigned long long errors;      /**< telegrams which could not be parsed */
+			} stats_t;
+
+			Protocol(const std::string &name) : _name(name), _connected(true), _deadline(-1) {
+				_stats.bytes = _stats.telegrams = _stats.errors = 0;
+			};
 
 			virtual ~Protocol() {};
 
@@ -51,9 +64,58 @@ namespace vz {
 			virtual ssize_t read(std::vector<Reading> &rds, size_t n) = 0;
 
 			const std::string &name() { return _name; }
-    
+			const stats_t &stats() const { return _stats; }
+
+			/**
+			 * False once the connection to the meter has been lost, until it is reopened
+			 */
+			const bool connected() const { return _connected; }
+			void connected(bool connected) { _connected = connected; }
+
+			/**
+			 * Give up waiting for the meter after the given time without data
+			 *
+			 * @param seconds 0 to wait forever
+			 */
+			void deadline(double seconds) { _deadline = (seconds > 0) ? (int) (seconds * 1e3) : -1; }
+
+		protected:
+			void received(size_t bytes) { _stats.bytes += bytes; }
+			void parsed(bool success = true) { if (success) _stats.telegrams++; else _stats.errors++; }
+			const int deadline() const { return _deadline; }
+
+			/**
+			 * Open a TCP connection without blocking longer than timeout
+			 *
+			 * All addresses of node are tried in turn.
+			 *
+			 * @param timeout milliseconds to wait for each address
+			 * @return the connected socket or ERR
+			 */
+			int connect(const char *node, const char *service, int timeout);
+
+			/**
+			 * Mark the connection as lost if read() returned end of file or a permanent error
+			 *
+			 * @param bytes return value of read()
+			 * @return true if the connection has been lost
+			 */
+			bool lost(ssize_t bytes);
+
+			/**
+			 * Block until fd has data to read, but not longer than the deadline
+			 *
+			 * A meter which stays silent until the deadline is treated like a lost connection.
+			 *
+			 * @return false if the connection has been lost instead
+			 */
+			bool readable(int fd);
+
 		private:
 			std::string _name;
+			stats_t _stats;
+			bool _connected;
+			int _deadline;          /**< milliseconds to wait for data, -1 for ever */
     
 		}; // class protocol
 	} // namespace protocol
@@ -0,0 +1,97 @@
+/**
+ * Streaming decoder for the smart message language (SML)
+ *
+ * @package vzlogger
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @license http://www.gnu.org/licenses/gpl.txt GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SML_DECODER_H_
+#define _SML_DECODER_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include <Reading.hpp>
+
+/**
+ * Decodes SML files without building an intermediate tree
+ *
+ * The TLV encoded messages are walked directly in the receive buffer.
+ * Only the value lists of GetListResponse messages are evaluated,
+ * everything else is skipped. Numeric list entries are stored into the
+ * callers readings, OBIS identifiers are interned so that decoding a file
+ * does not allocate any memory once all identifiers have been seen.
+ */
+class SmlDecoder {
+
+public:
+	SmlDecoder();
+
+	/**
+	 * Decode a SML file
+	 *
+	 * @param buffer the file without start and end escape sequences
+	 * @param len length of buffer
+	 * @param rds the readings to store to
+	 * @param n maximum number of readings to store
+	 * @return number of readings stored
+	 */
+	size_t decode(const unsigned char *buffer, size_t len, std::vector<Reading> &rds, size_t n);
+
+private:
+	typedef enum {
+		sml_octet_string = 0x00,
+		sml_boolean      = 0x40,
+		sml_integer      = 0x50,
+		sml_unsigned     = 0x60,
+		sml_list         = 0x70
+	} type_t;
+
+	typedef struct {
+		const unsigned char *p;
+		const unsigned char *end;
+	} cursor_t;
+
+	typedef struct {
+		unsigned char obis[6];
+		ReadingIdentifier::Ptr id;
+	} intern_t;
+
+	/**
+	 * Read type-length field
+	 *
+	 * @param len number of elements for lists, number of data bytes otherwise
+	 * @return false if the buffer is exhausted or the field is malformed
+	 */
+	static bool _tl(cursor_t &cur, int &type, size_t &len);
+	static bool _skip(cursor_t &cur, int depth = 0);
+	static bool _integer(cursor_t &cur, int64_t &value, bool &present, bool &is_unsigned);
+
+	bool _message(cursor_t &cur, std::vector<Reading> &rds, size_t n, size_t &m);
+	bool _list_response(cursor_t &cur, std::vector<Reading> &rds, size_t n, size_t &m);
+	bool _entry(cursor_t &cur, Reading &rd, bool &valid);
+
+	ReadingIdentifier::Ptr _intern(const unsigned char *obis);
+
+	std::vector<intern_t> _identifiers;  /**< interned OBIS identifiers */
+	struct timeval _now;                 /**< local time of the current file */
+};
+
+#endif /* _SML_DECODER_H_ */
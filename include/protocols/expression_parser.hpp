@@ -16,6 +16,8 @@
       ceil(x), round(x), with input arguments checked for domain validity, e.g.
 	  'sqrt( -1.0 )' returns an error.
 
+ Expressions are compiled once into a small stack based program by expression_compile() and evaluated by expression_evaluate() without any allocation. A printf style integer conversion like %u is compiled into a variable, which is bound at evaluation time.
+
  The library is also thread safe, allowing multiple parsers to be operated (on  different inputs) simultaneously.
  
  Error handling is achieved using the setjmp() and longjmp() commands. To the best of my knowledge these are available on nearly all platforms, including embedded, platforms so the library should run happily even on AVRs (this has not been tested).
@@ -35,6 +37,62 @@
 #define PARSER_MAX_TOKEN_SIZE 256
 #endif
 
+/**
+ @brief maximum number of instructions and stack depth of a compiled expression
+*/
+#if !defined(EXPRESSION_MAX_CODE)
+#define EXPRESSION_MAX_CODE 64
+#endif
+#if !defined(EXPRESSION_MAX_STACK)
+#define EXPRESSION_MAX_STACK 16
+#endif
+
+/**
+ @brief instructions of the expression evaluator, each one operates on the top of the stack
+*/
+typedef enum {
+	EXPR_PUSH,	/**< push the constant value */
+	EXPR_VAR,	/**< push the variable */
+	EXPR_NEG,
+	EXPR_ADD,
+	EXPR_SUB,
+	EXPR_MUL,
+	EXPR_DIV,
+	EXPR_POW,
+	EXPR_ATAN2,
+	EXPR_SQRT,
+	EXPR_LOG,
+	EXPR_EXP,
+	EXPR_SIN,
+	EXPR_ASIN,
+	EXPR_COS,
+	EXPR_ACOS,
+	EXPR_TAN,
+	EXPR_ATAN,
+	EXPR_ABS,
+	EXPR_FLOOR,
+	EXPR_CEIL,
+	EXPR_ROUND
+} expression_op;
+
+typedef struct {
+	expression_op op;
+	double value;
+} expression_instr;
+
+/**
+ @brief a compiled expression in postfix order
+*/
+typedef struct {
+	expression_instr code[EXPRESSION_MAX_CODE];
+
+	/** @brief number of instructions */
+	uint32_t len;
+
+	/** @brief maximum stack depth required for evaluation */
+	uint32_t stack;
+} expression_program;
+
 /**
  @brief main data structure for the parser, holds a pointer to the input string and the index of the current position of the parser in the input
 */
@@ -54,6 +112,12 @@ typedef struct {
 	
 	/** @brief error string to display, or query on failure */
 	const char *error;
+
+	/** @brief program the instructions are emitted to */
+	expression_program *prog;
+
+	/** @brief current stack depth of the emitted program */
+	int depth;
 } parser_data;
 
 /**
@@ -64,11 +128,28 @@ typedef struct {
 double parse_expression( const char *expr );
 
 /**
- @brief primary public routine for the library
- @param[in] expr expression to parse
- @return expression value
+ @brief compiles an expression for repeated evaluation
+ @param[in] expr expression to compile
+ @param[out] prog the compiled program
+ @param[out] error error string on failure
+ @return 0 on success, -1 on failure
  */
-double parser_parse( parser_data *pd );
+int expression_compile( const char *expr, expression_program *prog, const char **error );
+
+/**
+ @brief evaluates a compiled expression
+ @param[in] prog the compiled program
+ @param[in] var value of the variable
+ @return expression value, nan if a builtin function was called outside of its domain
+ */
+double expression_evaluate( const expression_program *prog, double var );
+
+/**
+ @brief primary public routine for the library, emits the program for pd->str to pd->prog
+ @param[in] pd input parser_data structure to operate on
+ @return 0 on success, -1 on failure
+ */
+int parser_parse( parser_data *pd );
 
 /**
  @brief allocates a new parser_data structure and initializes the member variables
@@ -89,6 +170,14 @@ void parser_data_free( parser_data *pd );
  */
 void parser_error( parser_data *pd, const char *err );
 
+/**
+ @brief appends an instruction to the program, fails if the program gets too large
+ @param[in] pd input parser_data structure to operate on
+ @param[in] op the instruction
+ @param[in] value constant for EXPR_PUSH
+ */
+void parser_emit( parser_data *pd, expression_op op, double value );
+
 /**
  @brief looks at a input character, potentially offset from the current character, without consuming any
  @param[in] pd input parser_data structure to operate on
@@ -110,55 +199,54 @@ char parser_eat( parser_data *pd );
  */
 void parser_eat_whitespace( parser_data *pd );
 
+/**
+ @brief reads a printf style conversion like %u or %f, which is used as variable
+ @param[in] pd input parser_data structure to operate on
+ */
+void parser_read_variable( parser_data *pd );
+
 /**
  @brief reads and converts a double precision floating point value in one of the many forms,
- e.g. +1.0, -1.0, -1, +1, -1., 1., 0.5, .5, .5e10, .5e-2
+ e.g. +1.0, -1.0, -1, +1, -1., 1., 0.5, .5, .5e10, .5e-2 or an optionally signed variable
  @param[in] pd input parser_data structure to operate on
- @return parsed value as double precision floating point number
  */
-double parser_read_double( parser_data *pd );
+void parser_read_double( parser_data *pd );
 
 /**
  @brief reads arguments for the builtin functions, auxilliary function for 
  parser_read_builtin()
  @param[in] pd input parser_data structure to operate upon
- @return value of the argument that was read
  */
-double parser_read_argument( parser_data *pd ); 
+void parser_read_argument( parser_data *pd ); 
 
 /**
  @brief reads and calls built-in functions, like sqrt(.), pow(.), etc.
  @param[in] pd input parser_data structure to operate upon
- @return resulting value
 */
-double parser_read_builtin( parser_data *pd );
+void parser_read_builtin( parser_data *pd );
 
 /**
  @brief attempts to read an expression in parentheses, or failing that a literal value
  @param[in] pd input parser_data structure to operate upon
- @return expression/literal value
  */
-double parser_read_paren( parser_data *pd );
+void parser_read_paren( parser_data *pd );
 
 /**
  @brief attempts to read an exponentiation operator, or failing that, a parenthetical expression 
  @param[in] pd input parser_data structure to operate upon
- @return exponentiation value
  */
-double parser_read_power( parser_data *pd );
+void parser_read_power( parser_data *pd );
 	
 /**
  @brief reads a term in an expression
  @param[in] pd input parser_data structure to operate on
- @return value of the term
  */
-double parser_read_term( parser_data *pd );
+void parser_read_term( parser_data *pd );
 
 /**
  @brief attempts to read an expression
  @param[in] pd input parser_data structure
- @return expression value
  */
-double parser_read_expr( parser_data *pd );
+void parser_read_expr( parser_data *pd );
 
 #endif
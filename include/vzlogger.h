@@ -36,7 +36,8 @@
 using namespace std;
 
 /* prototypes */
-void quit(int sig);
+int supervise();
+void reload();
 void daemonize();
 
 void show_usage(char ** argv);
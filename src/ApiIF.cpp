@@ -0,0 +1,127 @@
+/**
+ * Common code of the middleware APIs
+ *
+ * @package vzlogger
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @license http://www.gnu.org/licenses/gpl.txt GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include <ApiIF.hpp>
+#include <Options.hpp>
+#include <VZException.hpp>
+
+vz::ApiIF::ApiIF(Channel::Ptr ch)
+		: _ch(ch)
+		, _retrying(false)
+		, _delivered(0)
+		, _requests(0)
+		, _failures(0)
+		, _duration(0)
+		, _random(1)
+{
+	OptionList optlist;
+
+	try {
+		_stats_interval = optlist.lookup_int(ch->options(), "statistics");
+	} catch( vz::OptionNotFoundException &e ) {
+		_stats_interval = 0; /* disabled */
+	} catch( vz::VZException &e ) {
+		print(log_error, "Invalid type for statistics", ch->name());
+		throw;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &_stats_time);
+}
+
+void vz::ApiIF::delivered(const std::list<Reading> &values, double duration) {
+	_retrying = false;
+	if (_stats_interval <= 0) return;
+
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	double now = tv.tv_sec + tv.tv_usec / 1e6;
+
+	for (std::list<Reading>::const_iterator it = values.begin(); it != values.end(); it++) {
+		double latency = now - it->tvtod();
+
+		/* reservoir sampling keeps the percentiles unbiased at high rates */
+		if (_latencies.size() < API_LATENCY_SAMPLES) {
+			_latencies.push_back(latency);
+		}
+		else {
+			size_t k = rand_r(&_random) % (_delivered + 1);
+			if (k < API_LATENCY_SAMPLES) _latencies[k] = latency;
+		}
+		_delivered++;
+	}
+
+	_requests++;
+	_duration += duration;
+
+	_report();
+}
+
+void vz::ApiIF::failed() {
+	_retrying = true;
+	if (_stats_interval <= 0) return;
+
+	_failures++;
+	_report();
+}
+
+void vz::ApiIF::_report() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	double elapsed = (now.tv_sec - _stats_time.tv_sec) + (now.tv_nsec - _stats_time.tv_nsec) / 1e9;
+	if (elapsed < _stats_interval) return;
+
+	print(log_info, "Delivery: %.1f readings/s in %lu requests (avg. %.0f ms), %lu failed", channel()->name(),
+				_delivered / elapsed, _requests, _requests ? _duration * 1e3 / _requests : 0.0, _failures);
+
+	if (!_latencies.empty()) {
+		std::vector<double>::iterator p50 = _latencies.begin() + _latencies.size() / 2;
+		std::vector<double>::iterator p99 = _latencies.begin() + _latencies.size() * 99 / 100;
+
+		std::nth_element(_latencies.begin(), p99, _latencies.end());
+		double max = *std::max_element(p99, _latencies.end());
+		double l99 = *p99;
+		std::nth_element(_latencies.begin(), p50, p99);
+
+		print(log_info, "Delivery: latency from reading to middleware p50=%.3f s, p99=%.3f s, max=%.3f s",
+					channel()->name(), *p50, l99, max);
+	}
+
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0) {
+		print(log_debug, "Process: cpu user=%ld.%03lds system=%ld.%03lds, max. rss=%ld kB", channel()->name(),
+					usage.ru_utime.tv_sec, usage.ru_utime.tv_usec / 1000,
+					usage.ru_stime.tv_sec, usage.ru_stime.tv_usec / 1000, usage.ru_maxrss);
+	}
+
+	_latencies.clear();
+	_delivered = _requests = _failures = 0;
+	_duration = 0;
+	_stats_time = now;
+}
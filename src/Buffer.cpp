@@ -46,16 +46,12 @@ void Buffer::push(const Reading &rd) {
 
 void Buffer::clean() {
 	lock();
-	for(iterator it = _sent.begin(); it!= _sent.end(); it++) {
+	for(iterator it = _sent.begin(); it!= _sent.end(); ) {
 		if(it->deleted()) {
-			if( it == _sent.begin() ){
-				_sent.erase(it);
-				it = _sent.begin();
-			} else {
-				it = _sent.erase(it);
-			}
+			it = _sent.erase(it);
+		} else {
+			it++;
 		}
-
 	}
 //_sent.clear();
 	unlock();
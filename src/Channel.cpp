@@ -41,6 +41,7 @@ Channel::Channel(
 	ReadingIdentifier::Ptr pIdentifier
 	)
 		: _thread_running(false)
+		, _draining(false)
 		, _options(pOptions)
 		, _buffer(new Buffer())
 		, _identifier(pIdentifier)
@@ -0,0 +1,127 @@
+/**
+ * Source of time for readings and periodic sleeps
+ *
+ * @package vzlogger
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @license http://www.gnu.org/licenses/gpl.txt GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <math.h>
+
+#include <Clock.hpp>
+
+bool vz::Clock::_warp = false;
+double vz::Clock::_start = 0;
+double vz::Clock::_end = 0;
+__thread double vz::Clock::_now = 0;
+
+static double wallclock() {
+	struct timeval tv;
+	::gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+void vz::Clock::warp(double duration) {
+	_start = wallclock();
+	_end = _start + duration;
+	_warp = true;
+}
+
+double vz::Clock::now() {
+	if (!_warp) return wallclock();
+
+	if (_now == 0) _now = _start; /* first use by this thread */
+	return _now;
+}
+
+void vz::Clock::gettimeofday(struct timeval *tv) {
+	if (!_warp) {
+		::gettimeofday(tv, NULL);
+		return;
+	}
+
+	double t = now();
+	tv->tv_sec = (time_t) t;
+	tv->tv_usec = (suseconds_t) ((t - tv->tv_sec) * 1e6);
+}
+
+void vz::Clock::sleep(double seconds) {
+	if (seconds <= 0) return;
+
+	if (_warp) {
+		_now = now() + seconds;
+		return;
+	}
+
+	struct timespec ts;
+	ts.tv_sec = (time_t) seconds;
+	ts.tv_nsec = (long) ((seconds - ts.tv_sec) * 1e9);
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR);
+}
+
+void vz::Clock::sleep_until(double deadline) {
+	if (_warp) {
+		if (deadline > now()) _now = deadline;
+		return;
+	}
+
+	/* absolute deadlines on the realtime clock follow adjustments of the wall clock */
+	struct timespec ts;
+	ts.tv_sec = (time_t) deadline;
+	ts.tv_nsec = (long) ((deadline - ts.tv_sec) * 1e9);
+	while (clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+bool vz::Clock::expired() {
+	return _warp && now() >= _end;
+}
+
+vz::Timer::Timer(double period, bool align)
+		: _period(period)
+		, _align(align)
+		, _origin(0)
+		, _tick(0)
+{
+}
+
+unsigned long vz::Timer::wait() {
+	double now = Clock::now();
+	unsigned long skipped = 0;
+
+	if (_origin == 0) {
+		/* an aligned grid starts at the next multiple of the period */
+		_origin = _align ? ceil(now / _period) * _period : now + _period;
+		_tick = 0;
+	}
+	else {
+		_tick++;
+	}
+
+	/* deadlines are computed from the origin to avoid accumulating rounding errors */
+	double deadline = _origin + _tick * _period;
+	if (deadline < now) {
+		skipped = (unsigned long) ceil((now - deadline) / _period);
+		_tick += skipped;
+		deadline = _origin + _tick * _period;
+	}
+
+	Clock::sleep_until(deadline);
+	return skipped;
+}
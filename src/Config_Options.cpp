@@ -34,6 +34,79 @@
 
 static const char *option_type_str[] = { "null", "boolean", "double", "int", "object", "array", "string" };
 
+/**
+ * Types of the known meter and channel options
+ *
+ * Options are checked once while parsing the configuration, type_double
+ * accepts integers too. Unknown options are passed through unchecked.
+ */
+static const config_schema_t meter_schema[] = {
+	{ "enabled",     Option::type_boolean },
+	{ "protocol",    Option::type_string },
+	{ "interval",    Option::type_double },
+	{ "align",       Option::type_boolean },
+	{ "watchdog",    Option::type_double },
+	{ "statistics",  Option::type_int },
+	{ "host",        Option::type_string },
+	{ "device",      Option::type_string },
+	{ "baudrate",    Option::type_int },
+	{ "resolution",  Option::type_int },
+	{ "debounce",    Option::type_int },
+	{ "window",      Option::type_int },
+	{ "inputs",      Option::type_array },
+	{ "min",         Option::type_double },
+	{ "max",         Option::type_double },
+	{ "rate",        Option::type_double },
+	{ "seed",        Option::type_int },
+	{ "period",      Option::type_int },
+	{ "identifiers", Option::type_int },
+	{ "model",       Option::type_string },
+	{ "path",        Option::type_string },
+	{ "format",      Option::type_string },
+	{ "rewind",      Option::type_boolean },
+	{ "command",     Option::type_string },
+	{ "persistent",  Option::type_boolean },
+	{ "fifo",        Option::type_string },
+	{ "ip",          Option::type_string },
+	{ "port",        Option::type_int },
+	{ "slave",       Option::type_int },
+	{ "timeout",     Option::type_int },
+	{ "backoff",     Option::type_int },
+	{ "pipeline",    Option::type_int },
+	{ "max_gap",     Option::type_int },
+	{ "parity",      Option::type_string },
+	{ "databits",    Option::type_int },
+	{ "stopbits",    Option::type_int },
+	{ "addresses",   Option::type_array },
+	{ NULL,          Option::type_null }
+};
+
+static const config_schema_t channel_schema[] = {
+	{ "middleware",  Option::type_string },
+	{ "timeout",     Option::type_int },
+	{ "statistics",  Option::type_int },
+	{ "interval",    Option::type_int },
+	{ "scaler",      Option::type_int },
+	{ "type",        Option::type_string },
+	{ "secretKey",   Option::type_string },
+	{ "name",        Option::type_string },
+	{ NULL,          Option::type_null }
+};
+
+void config_validate(const std::list<Option> &options, const config_schema_t *schema) {
+	for (std::list<Option>::const_iterator it = options.begin(); it != options.end(); it++) {
+		const config_schema_t *entry;
+		for (entry = schema; entry->key != NULL && it->key() != entry->key; entry++);
+
+		if (entry->key == NULL || it->type() == entry->type) continue;
+		if (entry->type == Option::type_double && it->type() == Option::type_int) continue;
+
+		print(log_error, "Invalid type for %s: %s instead of %s", NULL, entry->key,
+					option_type_str[it->type()], option_type_str[entry->type]);
+		throw vz::InvalidTypeException("Invalid type for " + it->key());
+	}
+}
+
 Config_Options::Config_Options()
 		:  _config("/etc/vzlogger.conf")
 		, _log("")
@@ -42,6 +115,7 @@ Config_Options::Config_Options()
 		, _comet_timeout(30)
 		, _buffer_length(600)
 		, _retry_pause(15)
+		, _shutdown_timeout(10)
 		, _daemon(false)
 		, _foreground(false)
 		, _local(false)
@@ -60,6 +134,7 @@ Config_Options::Config_Options(
 		, _comet_timeout(30)
 		, _buffer_length(600)
 		, _retry_pause(15)
+		, _shutdown_timeout(10)
 		, _daemon(false)
 		, _foreground(false)
 		, _local(false)
@@ -127,6 +202,9 @@ void Config_Options::config_parse(
 			else if (strcmp(key, "retry") == 0 && type == json_type_int) {
 				_retry_pause = json_object_get_int(value);
 			}
+			else if (strcmp(key, "shutdown") == 0 && type == json_type_int) {
+				_shutdown_timeout = json_object_get_int(value);
+			}
 			else if (strcmp(key, "verbosity") == 0 && type == json_type_int) {
 				_verbosity = json_object_get_int(value);
 			}
@@ -184,6 +262,7 @@ void Config_Options::config_parse(
 void Config_Options::config_parse_meter(MapContainer &mappings, Json::Ptr jso) {
 	std::list<Json> json_channels;
 	std::list<Option> options;
+	json_object *json_meter = json_object_new_object(); /* meter configuration without channels */
 
 	json_object_object_foreach(jso->Object(), key, value) {
 		enum json_type type = json_object_get_type(value);
@@ -200,11 +279,16 @@ void Config_Options::config_parse_meter(MapContainer &mappings, Json::Ptr jso) {
 		else { /* all other options will be passed to meter_init() */
 			Option option(key, value);
 			options.push_back(option);
+			json_object_object_add(json_meter, key, json_object_get(value));
 		}
 	}
 
+	config_validate(options, meter_schema);
+
 	/* init meter */
-	MeterMap  metermap(options);
+	std::string config(json_object_to_json_string(json_meter));
+	json_object_put(json_meter);
+	MeterMap  metermap(options, config);
 
 	print(log_info, "New meter initialized (protocol=%s)", NULL/*(mapping*/,
 				meter_get_details(metermap.meter()->protocolId())->name);
@@ -250,6 +334,8 @@ void Config_Options::config_parse_channel(Json &jso, MeterMap &mapping)
 		}
 	}
 
+	config_validate(options, channel_schema);
+
 	/* check uuid and middleware */
 	if (uuid == NULL) {
 		print(log_error, "Missing UUID", NULL);
@@ -273,6 +359,9 @@ void Config_Options::config_parse_channel(Json &jso, MeterMap &mapping)
 		if( id_str != NULL ) {
 			id = reading_id_parse(mapping.meter()->protocolId(), (const char *)id_str);
 		}
+		else if (mapping.meter()->protocolId() == meter_protocol_s0) {
+			id = reading_id_parse(meter_protocol_s0, ""); /* the pulses since the last reading */
+		}
 	} catch ( vz::VZException &e ) {
 		std::stringstream oss;
 		oss << e.what();
@@ -281,6 +370,7 @@ void Config_Options::config_parse_channel(Json &jso, MeterMap &mapping)
 	}
 
 	Channel::Ptr ch(new Channel(options, apiProtocol_str, uuid, id));
+	ch->config(json_object_to_json_string(jso.Object()));
 	print(log_info, "New channel initialized (uuid=...%s protocol=%s id=%s)", ch->name(),
 				uuid+30, apiProtocol_str, (id_str) ? id_str : "(none)");
 	mapping.push_back(ch);
@@ -25,6 +25,8 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
+#include <math.h>
 
 #include "Meter.hpp"
 #include "Options.hpp"
@@ -52,20 +54,26 @@
 
 int Meter::instances=0;
 
+static double monotonic() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 static const meter_details_t protocols[] = {
 /*     aliasdescriptionmax_rdsperiodic
 			 ===============================================================================================*/
 	METER_DETAIL( file, File,"Read from file or fifo",32,true),
-//METER_DETAIL(exec, "Parse program output",32,true),
-	METER_DETAIL(random, Random, "Generate random values with a random walk",1,true),
+	METER_DETAIL(exec, Exec, "Parse program output",32,true),
+	METER_DETAIL(random, Random, "Generate random values with a random walk",1000,true),
 	METER_DETAIL(fluksov2, Fluksov2,"Read from Flukso's onboard SPI fifo",16,false),
-	METER_DETAIL(s0, S0,"S0-meter directly connected to RS232",3,true),
+	METER_DETAIL(s0, S0,"S0-meter directly connected to RS232",48,true),
 	METER_DETAIL(d0, D0,"DLMS/IEC 62056-21 plaintext protocol",32,false),
 #ifdef SML_SUPPORT
 	METER_DETAIL(sml, Sml,"Smart Message Language as used by EDL-21, eHz and SyM²", 32,false),
 #endif /* SML_SUPPORT */
 #ifdef MODBUS_SUPPORT
-	METER_DETAIL(modbus, Modbus, "Modbus", 100, true),
+	METER_DETAIL(modbus, Modbus, "Modbus", 1000, true),
 #endif
 //{} /* stop condition for iterator */
 	METER_DETAIL(none, NULL,NULL, 0,false),
@@ -73,6 +81,7 @@ static const meter_details_t protocols[] = {
 
 Meter::Meter(std::list<Option> pOptions) :
 		_name("meter")
+		, _open(false)
 {
 	id = instances++;
 	OptionList optlist;
@@ -103,8 +112,8 @@ Meter::Meter(std::list<Option> pOptions) :
 
 	try {
 /* interval */
-		Option interval_opt = optlist.lookup(pOptions, "interval");
-		_interval = (int)(interval_opt);
+		_interval = optlist.lookup_double(pOptions, "interval");
+		_interval = floor(_interval * 1e3 + 0.5) / 1e3;
 	} catch( vz::OptionNotFoundException &e ) {
 		_interval = -1; /* indicates unknown interval */
 	} catch( vz::VZException &e ) {
@@ -112,6 +121,37 @@ Meter::Meter(std::list<Option> pOptions) :
 		throw;
 	}
 
+	try {
+		_align = optlist.lookup_bool(pOptions, "align", false);
+	} catch( vz::VZException &e ) {
+		print(log_error, "Invalid type for align", name());
+		throw;
+	}
+
+	try {
+/* statistics */
+		_stats_interval = optlist.lookup_int(pOptions, "statistics");
+	} catch( vz::OptionNotFoundException &e ) {
+		_stats_interval = 0; /* disabled */
+	} catch( vz::VZException &e ) {
+		print(log_error, "Invalid type for statistics", name());
+		throw;
+	}
+	try {
+		_watchdog = optlist.lookup_double(pOptions, "watchdog", 0);
+		if (_watchdog < 0) throw vz::VZException("Watchdog must not be negative.");
+	} catch( vz::VZException &e ) {
+		print(log_error, "Invalid type for watchdog", name());
+		throw;
+	}
+	_fresh = monotonic();
+	pthread_mutex_init(&_mutex, NULL);
+
+	_cpu = _stats_cpu = 0;
+	_readings = _stats_readings = 0;
+	_stats.bytes = _stats.telegrams = _stats.errors = 0;
+	clock_gettime(CLOCK_MONOTONIC, &_stats_time);
+
 	try{
 		const meter_details_t *details = meter_get_details(_protocol_id);
 		if (details->periodic == true && _interval < 0) {
@@ -131,10 +171,22 @@ Meter::Meter(std::list<Option> pOptions) :
 			case meter_protocol_exec:
 				_protocol = vz::protocol::Protocol::Ptr(new MeterExec(pOptions));
 				_identifier = ReadingIdentifier::Ptr(new StringIdentifier());
+				if (optlist.lookup_bool(pOptions, "persistent", false)) {
+					if (_interval > 0) {
+						print(log_warning, "Ignoring the interval, readings are paced by the program", name());
+					}
+					_interval = 0; /* every line printed is a reading */
+				}
 				break;
 			case meter_protocol_random:
 				_protocol = vz::protocol::Protocol::Ptr(new MeterRandom(pOptions));
 				_identifier = ReadingIdentifier::Ptr(new NilIdentifier());
+				if (optlist.lookup_double(pOptions, "rate", 0) > 0) {
+					if (_interval > 0) {
+						print(log_warning, "Ignoring the interval, readings are paced by the rate", name());
+					}
+					_interval = 0; /* the load generator paces itself */
+				}
 				break;
 			case meter_protocol_s0:
 				_protocol = vz::protocol::Protocol::Ptr(new MeterS0(pOptions));
@@ -163,6 +215,16 @@ Meter::Meter(std::list<Option> pOptions) :
 			default:
 				break;
 	}
+	/* every interval without readings would reset the meter otherwise */
+	if (_watchdog > 0 && _interval > 0 && _watchdog <= _interval) {
+		print(log_error, "The watchdog (%.1f s) has to exceed the interval (%.1f s)", name(), _watchdog, _interval);
+		throw vz::VZException("Watchdog too short.");
+	}
+
+	if (_protocol) {
+		_protocol->deadline(_watchdog);
+		_stats = _protocol->stats(); /* the first report starts from here */
+	}
 
 	try {
 /* interval */
@@ -181,22 +243,106 @@ Meter::Meter(std::list<Option> pOptions) :
 //}
 
 Meter::~Meter() {
+	pthread_mutex_destroy(&_mutex);
 }
 
 void Meter::open() {
+	if (isOpen()) {
+		return;
+	}
 	if( _protocol->open() < 0) {
 		print(log_error, "Cannot open meter", name());
 		throw vz::ConnectionException("Meteropen failed.");
 	}
+	_protocol->connected(true);
 
+	pthread_mutex_lock(&_mutex);
+	_open = true;
+	_fresh = monotonic();
+	pthread_mutex_unlock(&_mutex);
 }
 
 int Meter::close() {
+	pthread_mutex_lock(&_mutex);
+	bool open = _open;
+	_open = false;
+	pthread_mutex_unlock(&_mutex);
+
+	if (!open) {
+		return SUCCESS;
+	}
 	return _protocol->close();
 }
 
+const bool Meter::isOpen() const {
+	pthread_mutex_lock(&_mutex);
+	bool open = _open;
+	pthread_mutex_unlock(&_mutex);
+
+	return open;
+}
+
 size_t Meter::read(std::vector<Reading> &rds, size_t n) {
-	return _protocol->read(rds, n);
+	struct timespec start, end;
+
+	/* cpu time excludes the time blocked waiting for the meter */
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+	ssize_t i = _protocol->read(rds, n);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+
+	_cpu += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	if (i > 0) {
+		_readings += i;
+		pthread_mutex_lock(&_mutex);
+		_fresh = monotonic();
+		pthread_mutex_unlock(&_mutex);
+	}
+
+	if (_stats_interval > 0) {
+		_report();
+	}
+
+	/* the reading thread reopens the meter before the next read */
+	if (!_protocol->connected()) {
+		print(log_warning, "Lost connection to meter", name());
+		close();
+	}
+
+	return (i > 0) ? i : 0;
+}
+
+double Meter::stale() const {
+	pthread_mutex_lock(&_mutex);
+	double fresh = _fresh;
+	pthread_mutex_unlock(&_mutex);
+
+	return monotonic() - fresh;
+}
+
+void Meter::_report() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	double elapsed = (now.tv_sec - _stats_time.tv_sec) + (now.tv_nsec - _stats_time.tv_nsec) / 1e9;
+	if (elapsed < _stats_interval) return;
+
+	const vz::protocol::Protocol::stats_t &stats = _protocol->stats();
+	double telegrams = stats.telegrams - _stats.telegrams;
+	double bytes = stats.bytes - _stats.bytes;
+	double cpu = _cpu - _stats_cpu;
+
+	print(log_info, "Statistics: %.1f telegrams/s, %.2f kB/s, %.1f readings/s, %llu errors", name(),
+				telegrams / elapsed, bytes / elapsed / 1e3, (_readings - _stats_readings) / elapsed,
+				stats.errors - _stats.errors);
+	if (cpu > 0 && telegrams > 0) {
+		print(log_info, "Statistics: parsing takes %.1f us/telegram, %.2f MB/s of cpu time", name(),
+					cpu * 1e6 / telegrams, bytes / cpu / 1e6);
+	}
+
+	_stats = stats;
+	_stats_cpu = _cpu;
+	_stats_readings = _readings;
+	_stats_time = now;
 }
 
 int meter_lookup_protocol(const char* name, meter_protocol_t *protocol) {
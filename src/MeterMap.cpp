@@ -34,6 +34,9 @@
  * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
  */
 #include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
 
 #include <MeterMap.hpp>
 #include <Config_Options.hpp>
@@ -45,24 +48,14 @@ extern Config_Options options;	/* global application options */
 /**
 	 If the meter is enabled, start the meter and all its channels.
 */
-void MeterMap::start() {
+void MeterMap::start(int notify) {
 	if(_meter->isEnabled()) {
-		_meter->open();
-		print(log_info, "Meter connection established", _meter->name());
-		pthread_create(&_thread, NULL, &reading_thread, (void *) this);
-		print(log_debug, "Meter thread started", _meter->name());
+		_notify = notify;
+		/* the meter is opened by its reading thread, a slow meter must not delay the others */
+		_start_reader();
 
-		print(log_debug, "meter is opened. Start channels.", _meter->name());
 		for(iterator it = _channels.begin(); it!=_channels.end(); it++) {
-			/* set buffer length for perriodic meters */
-			if (meter_get_details(_meter->protocolId())->periodic && options.local()) {
-				(*it)->buffer()->keep(ceil(options.buffer_length() / (double) _meter->interval()));
-			}
-
-			if (options.logging()) {
-				(*it)->start();
-				print(log_debug, "Logging thread started", (*it)->name());
-			}
+			_start_channel(*it);
 		}
 		_thread_running = true;
 	} else {
@@ -71,33 +64,260 @@ void MeterMap::start() {
 	}
 
 }
-bool MeterMap::stopped() {
-	if(_meter->isEnabled()  && running() ) {
-		if( pthread_join(_thread, NULL) == 0 ) {
-			_thread_running = false;
 
-			// join channel-threads
-			for(iterator it = _channels.begin(); it!=_channels.end(); it++) {
-				(*it)->cancel();
-				(*it)->join();
-			}
-			return true;
-		}
+void MeterMap::_start_reader() {
+	_reader = _reading = true;
+	pthread_create(&_thread, NULL, &reading_thread, (void *) this);
+	print(log_debug, "Meter thread started", _meter->name());
+}
+
+void MeterMap::_start_channel(Channel::Ptr ch) {
+	/* set buffer length for perriodic meters */
+	if (meter_get_details(_meter->protocolId())->periodic && options.local()) {
+		ch->buffer()->keep(ceil(options.buffer_length() / (double) _meter->interval()));
+	}
+
+	if (options.logging()) {
+		ch->start();
+		print(log_debug, "Logging thread started", ch->name());
 	}
-	return false;
 }
 
-void MeterMap::cancel() {
-	if(_meter->isEnabled() && running() ) {
-		for(iterator it = _channels.begin(); it!=_channels.end(); it++) {
-			(*it)->cancel();
-			(*it)->join();
-		}
+void MeterMap::_join_channel(Channel::Ptr ch, const struct timespec &deadline) {
+	if (!ch->running() || ch->join(deadline)) {
+		return;
+	}
+	print(log_warning, "Giving up on delivering pending readings", ch->name());
+	ch->cancel();
+	ch->join();
+}
+
+void MeterMap::stop() {
+	if(_reader) {
 		pthread_cancel(_thread);
 		pthread_join(_thread, NULL);
-		_thread_running = false;
-		//_channels.clear();
+		_reader = _reading = false;
+		print(log_debug, "Meter thread stopped", _meter->name());
+	}
+}
+
+void MeterMap::drain(const struct timespec &deadline) {
+	if(!_meter->isEnabled() || !running()) {
+		return;
+	}
+
+	for(iterator it = _channels.begin(); it!=_channels.end(); it++) {
+		(*it)->drain();
+	}
+	for(iterator it = _channels.begin(); it!=_channels.end(); it++) {
+		_join_channel(*it, deadline);
+	}
+	_thread_running = false;
+}
+
+void MeterMap::update(MeterMap &other, const struct timespec &deadline) {
+	std::vector<Channel::Ptr> channels, added, removed;
+	std::vector<bool> kept(_channels.size(), false);
+
+	/* channels with an unchanged configuration are kept with their buffers */
+	for(iterator it = other.begin(); it!=other.end(); it++) {
+		size_t k;
+		for (k = 0; k < _channels.size(); k++) {
+			if (!kept[k] && _channels[k]->config() == (*it)->config()) break;
+		}
+
+		if (k < _channels.size()) {
+			kept[k] = true;
+			channels.push_back(_channels[k]);
+		}
+		else {
+			channels.push_back(*it);
+			added.push_back(*it);
+		}
+	}
+	for (size_t k = 0; k < _channels.size(); k++) {
+		if (!kept[k]) removed.push_back(_channels[k]);
+	}
+
+	if (added.empty() && removed.empty()) {
+		return;
+	}
+	print(log_info, "Updating channels: %u added, %u removed", _meter->name(), added.size(), removed.size());
+
+	if (!running()) {
+		_channels = channels;
+		return;
+	}
+
+	/* the reading thread iterates the channels, pause it while they are replaced */
+	stop();
+	for(iterator it = channels.begin(); it!=channels.end(); it++) {
+		(*it)->last(NULL); /* pointed to the readings of the stopped thread */
+	}
+	for(iterator it = added.begin(); it!=added.end(); it++) {
+		_start_channel(*it);
 	}
+	_channels = channels;
+	_start_reader();
+
+	/* removed channels no longer get readings, deliver what they have */
+	for(iterator it = removed.begin(); it!=removed.end(); it++) {
+		(*it)->drain();
+	}
+	for(iterator it = removed.begin(); it!=removed.end(); it++) {
+		_join_channel(*it, deadline);
+	}
+}
+
+void MeterMap::watchdog() {
+	if (!_reading || _meter->watchdog() <= 0) {
+		return;
+	}
+
+	double stale = _meter->stale();
+	if (stale <= _meter->watchdog()) {
+		if (_stalled) {
+			print(log_info, "Meter is no longer stalled", _meter->name());
+			_stalled = false;
+		}
+		return;
+	}
+
+	if (!_stalled) {
+		print(log_warning, "No readings for %.0f seconds", _meter->name(), stale);
+		_stalled = true;
+	}
+
+	/* a closed meter is being reopened by the reading thread */
+	if (_meter->isOpen() && stale > 2 * _meter->watchdog()) {
+		print(log_error, "Reading thread is stuck, resetting meter", _meter->name());
+		stop();
+		_meter->close();
+		_start_reader();
+	}
+}
+
+void MeterMap::finished() {
+	char c = 0;
+	_reading = false;
+	if (_notify >= 0 && write(_notify, &c, 1) < 0) {
+		print(log_error, "Cannot notify termination: %s", _meter->name(), strerror(errno));
+	}
+}
+
+MapContainer::~MapContainer() {
+	if (_finished[0] >= 0) {
+		::close(_finished[0]);
+		::close(_finished[1]);
+	}
+	pthread_mutex_destroy(&_mutex);
+}
+
+void MapContainer::start() {
+	if (pipe(_finished) < 0) {
+		throw vz::VZException("Cannot create pipe");
+	}
+	fcntl(_finished[0], F_SETFD, FD_CLOEXEC);
+	fcntl(_finished[1], F_SETFD, FD_CLOEXEC);
+
+	for(iterator it = _mappings.begin(); it!=_mappings.end(); it++) {
+		it->start(_finished[1]);
+	}
+}
+
+size_t MapContainer::reading() const {
+	size_t n = 0;
+
+	for(const_iterator it = _mappings.begin(); it!=_mappings.end(); it++) {
+		if (it->reading()) n++;
+	}
+	return n;
+}
+
+void MapContainer::shutdown(int timeout) {
+	print(log_info, "Stopping meters", (char*)0);
+	for(iterator it = _mappings.begin(); it!=_mappings.end(); it++) {
+		it->stop();
+	}
+
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout;
+
+	print(log_info, "Delivering pending readings within %d seconds", (char*)0, timeout);
+	for(iterator it = _mappings.begin(); it!=_mappings.end(); it++) {
+		it->drain(deadline);
+	}
+}
+
+bool MapContainer::watchdog() {
+	bool watched = false;
+
+	lock();
+	for(iterator it = _mappings.begin(); it!=_mappings.end(); it++) {
+		if (it->meter()->watchdog() > 0) {
+			it->watchdog();
+			watched = true;
+		}
+	}
+	unlock();
+
+	return watched;
+}
+
+void MapContainer::reload(MapContainer &fresh, int timeout) {
+	std::list<MeterMap> removed;
+	size_t kept = 0, started = 0;
+
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout;
+
+	lock();
+
+	/* meters with an unchanged configuration keep running */
+	for(iterator it = _mappings.begin(); it!=_mappings.end(); ) {
+		iterator match;
+		for (match = fresh.begin(); match != fresh.end() && match->config() != it->config(); match++);
+
+		if (match == fresh.end()) {
+			iterator next = it;
+			next++;
+			removed.splice(removed.end(), _mappings, it);
+			it = next;
+			continue;
+		}
+
+		it->update(*match, deadline);
+		fresh._mappings.erase(match);
+		kept++;
+		it++;
+	}
+
+	/* stop the old meters before their replacements open the same devices */
+	for(iterator it = removed.begin(); it!=removed.end(); it++) {
+		it->stop();
+	}
+	for(iterator it = removed.begin(); it!=removed.end(); it++) {
+		it->drain(deadline);
+		it->meter()->close();
+		print(log_info, "Meter stopped", it->meter()->name());
+	}
+
+	for(iterator it = fresh.begin(); it!=fresh.end(); it++) {
+		try {
+			it->start(_finished[1]);
+			started++;
+		} catch (std::exception &e) {
+			print(log_error, "Cannot start meter: %s", it->meter()->name(), e.what());
+		}
+	}
+	_mappings.splice(_mappings.end(), fresh._mappings);
+
+	unlock();
+
+	print(log_info, "Configuration reloaded: %u meters kept, %u stopped, %u started", (char*)0,
+				kept, removed.size(), started);
 }
 
 void MeterMap::registration() {
@@ -63,12 +63,44 @@ Option::Option(const char *pKey, struct json_object *jso)
 					param_ptr[i].function_code = (unsigned char)json_object_get_int(json_object_array_get_idx(cur_val,0));
 					param_ptr[i].address = json_object_get_int(json_object_array_get_idx(cur_val,1));
 					param_ptr[i].recalc_str = json_object_get_string(json_object_array_get_idx(cur_val,2));
+					/* optional slave id and period, null for the default */
+					struct json_object *slave = (json_object_array_length(cur_val) > 3) ? json_object_array_get_idx(cur_val,3) : NULL;
+					struct json_object *period = (json_object_array_length(cur_val) > 4) ? json_object_array_get_idx(cur_val,4) : NULL;
+					struct json_object *type = (json_object_array_length(cur_val) > 5) ? json_object_array_get_idx(cur_val,5) : NULL;
+					param_ptr[i].slave = (slave != NULL) ? json_object_get_int(slave) : -1;
+					param_ptr[i].period = (period != NULL) ? json_object_get_int(period) : 0;
+					param_ptr[i].type = (type != NULL) ? json_object_get_string(type) : NULL;
 					print(log_debug, "Added Function Code: %u, Address: %u, Recalc: %s", "Options", param_ptr->function_code, param_ptr->address, param_ptr->recalc_str);
 				}
 				param_ptr[length].function_code = 0xFF;
 				value.addressparams = (struct addressparam *)param_ptr;
 				break;
 			}
+			else if(!strcmp(pKey, "inputs"))
+			{
+				/* [ device, name, optional resolution, optional debounce ] */
+				length = json_object_array_length(jso);
+				struct inputparam *input_ptr = new struct inputparam[length + 1];
+				for(int i = 0; i < length; i++) {
+					struct json_object *cur_val = json_object_array_get_idx(jso, i);
+					int elements = json_object_array_length(cur_val);
+					struct json_object *resolution = (elements > 2) ? json_object_array_get_idx(cur_val, 2) : NULL;
+					struct json_object *debounce = (elements > 3) ? json_object_array_get_idx(cur_val, 3) : NULL;
+
+					input_ptr[i].device = json_object_get_string(json_object_array_get_idx(cur_val, 0));
+					input_ptr[i].name = json_object_get_string(json_object_array_get_idx(cur_val, 1));
+					input_ptr[i].resolution = (resolution != NULL) ? json_object_get_int(resolution) : -1;
+					input_ptr[i].debounce = (debounce != NULL) ? json_object_get_int(debounce) : -1;
+					if (input_ptr[i].device == NULL || input_ptr[i].name == NULL) {
+						delete[] input_ptr;
+						throw vz::VZException("Input needs a device and a name");
+					}
+					print(log_debug, "Added Input: %s, Name: %s", "Options", input_ptr[i].device, input_ptr[i].name);
+				}
+				input_ptr[length].device = NULL;
+				value.inputparams = input_ptr;
+				break;
+			}
 			
 			default:		throw vz::VZException("Not a valid Type");
 	}
@@ -130,6 +162,12 @@ Option::operator struct addressparam *() const {
 	return value.addressparams;
 }
 
+Option::operator struct inputparam *() const {
+	if (_type != type_array || _key != "inputs") throw vz::InvalidTypeException("Invalid type");
+
+	return value.inputparams;
+}
+
 
 Option::operator const char *() const {
 	if (_type != type_string) throw vz::InvalidTypeException("not a string");
@@ -144,6 +182,7 @@ Option::operator int() const {
 }
 
 Option::operator double() const {
+	if (_type == type_int) return value.integer; /* json has no distinct type for 1.0 */
 	if (_type != type_double) throw vz::InvalidTypeException("Invalid type");
 
 	return value.floating;
@@ -156,48 +195,80 @@ Option::operator bool() const {
 }
 
 //Option& OptionList::lookup(List<Option> options, char *key) {
-const Option &OptionList::lookup(std::list<Option> options, const std::string &key) {
+const Option &OptionList::lookup(const std::list<Option> &options, const std::string &key) {
+	const Option *option = find(options, key.c_str());
+
+	if (option == NULL) {
+		throw vz::OptionNotFoundException("Option '"+ std::string(key) +"' not found");
+	}
+	return *option;
+}
+
+const Option *OptionList::find(const std::list<Option> &options, const char *key) {
 	for(const_iterator it = options.begin(); it != options.end(); it++) {
 		if ( it->key() == key ) {
-			return (*it);
+			return &(*it);
 		}
 	}
+	return NULL;
+}
 
-	throw vz::OptionNotFoundException("Option '"+ std::string(key) +"' not found");
+const char *OptionList::lookup_string(const std::list<Option> &options, const char *key)
+{
+	return (const char*)lookup(options, key);
 }
 
-const char *OptionList::lookup_string(std::list<Option> options, const char *key)
+const int OptionList::lookup_int(const std::list<Option> &options, const char *key)
 {
-	Option opt = lookup(options, key);
-	return (const char*)opt;
+	return (int)lookup(options, key);
 }
 
-const int OptionList::lookup_int(std::list<Option> options, const char *key)
+const bool OptionList::lookup_bool(const std::list<Option> &options, const char *key)
 {
-	Option opt = lookup(options, key);
-	return (int)opt;
+	return (bool)lookup(options, key);
 }
 
-const bool OptionList::lookup_bool(std::list<Option> options, const char *key)
+const double OptionList::lookup_double(const std::list<Option> &options, const char *key)
 {
-	Option opt = lookup(options, key);
-	return (bool)opt;
+	return (double)lookup(options, key);
 }
 
-const double OptionList::lookup_double(std::list<Option> options, const char *key)
+
+const char *OptionList::lookup_string(const std::list<Option> &options, const char *key, const char *fallback)
 {
-	Option opt = lookup(options, key);
-	return (double)opt;
+	const Option *option = find(options, key);
+	return option ? (const char*)*option : fallback;
 }
 
+const int OptionList::lookup_int(const std::list<Option> &options, const char *key, int fallback)
+{
+	const Option *option = find(options, key);
+	return option ? (int)*option : fallback;
+}
+
+const bool OptionList::lookup_bool(const std::list<Option> &options, const char *key, bool fallback)
+{
+	const Option *option = find(options, key);
+	return option ? (bool)*option : fallback;
+}
+
+const double OptionList::lookup_double(const std::list<Option> &options, const char *key, double fallback)
+{
+	const Option *option = find(options, key);
+	return option ? (double)*option : fallback;
+}
+
+const struct addressparam *OptionList::lookup_addressparams(const std::list<Option> &options, const char *key)
+{
+	return (struct addressparam *)lookup(options, key);
+}
 
-const struct addressparam *OptionList::lookup_addressparams(std::list<Option> options, const char *key)
+const struct inputparam *OptionList::lookup_inputparams(const std::list<Option> &options, const char *key)
 {
-	Option opt = lookup(options, key);
-	return (struct addressparam *)opt;
+	return (struct inputparam *)lookup(options, key);
 }
 
-void OptionList::dump(std::list<Option> options) {
+void OptionList::dump(const std::list<Option> &options) {
 	std::cout<< "OptionList dump\n" ;
 
 	for(const_iterator it = options.begin(); it != options.end(); it++) {
@@ -124,12 +124,31 @@ ReadingIdentifier::Ptr reading_id_parse(meter_protocol_t protocol, const char *s
 
 			case meter_protocol_file:
 			case meter_protocol_exec:
+			case meter_protocol_random:
 				rid = ReadingIdentifier::Ptr(new StringIdentifier(string));
 				break;
 			case meter_protocol_modbus:
 				rid = ReadingIdentifier::Ptr(new AddressIdentifier(string));
 				break;
-				
+			case meter_protocol_s0: {
+				/* "[<input>/]power", "[<input>/]total" and "[<input>/]pulses",
+				 * anything else are the pulses since the last reading */
+				const char *type = strrchr(string, '/');
+				std::string input = (type != NULL) ? std::string(string, type - string + 1) : "";
+				type = (type != NULL) ? type + 1 : string;
+
+				if (strcasecmp(type, "power") == 0) {
+					rid = ReadingIdentifier::Ptr(new StringIdentifier(input + "Power"));
+				}
+				else if (strcasecmp(type, "total") == 0) {
+					rid = ReadingIdentifier::Ptr(new StringIdentifier(input + "Counter"));
+				}
+				else {
+					rid = ReadingIdentifier::Ptr(new StringIdentifier(input + "Pulses"));
+				}
+				break;
+			}
+
 			default: /* ignore other protocols which do not provide id's */
 				rid = ReadingIdentifier::Ptr(new NilIdentifier());
 				break;
@@ -148,27 +167,21 @@ bool ReadingIdentifier::operator==( ReadingIdentifier &cmp) {
 }
 
 bool ReadingIdentifier::compare( ReadingIdentifier *lhs,  ReadingIdentifier *rhs) {
-	if(AddressIdentifier* lhsx = dynamic_cast<AddressIdentifier*>(lhs)) {
-		if(AddressIdentifier* rhsx = dynamic_cast<AddressIdentifier*>(rhs)) {
-			return *lhsx == *rhsx;
-		} else { return -1; }
-	} else
-		if(ObisIdentifier* lhsx = dynamic_cast<ObisIdentifier*>(lhs)) {
-			if(ObisIdentifier* rhsx = dynamic_cast<ObisIdentifier*>(rhs)) {
-				return *lhsx == *rhsx;
-			} else { return -1; }
-		} else 
-			if( StringIdentifier* lhsx = dynamic_cast<StringIdentifier*>(rhs)) {
-				if(StringIdentifier* rhsx = dynamic_cast<StringIdentifier*>(lhs)) {
-					return lhsx == rhsx;
-				} else { return -1; }
-			} else 
-				if(ChannelIdentifier* lhsx = dynamic_cast<ChannelIdentifier*>(lhs)) {
-					if(ChannelIdentifier* rhsx = dynamic_cast<ChannelIdentifier*>(rhs)) {
-						return lhsx == rhsx;
-					} else { return -1; }
-				}
-	return -1;
+	/* identifiers of different kinds always match */
+	if (lhs->type() != rhs->type()) return true;
+
+	switch (lhs->type()) {
+			case type_address:
+				return *static_cast<AddressIdentifier*>(lhs) == *static_cast<AddressIdentifier*>(rhs);
+			case type_obis:
+				return *static_cast<ObisIdentifier*>(lhs) == *static_cast<ObisIdentifier*>(rhs);
+			case type_string:
+				return *static_cast<StringIdentifier*>(lhs) == *static_cast<StringIdentifier*>(rhs);
+			case type_channel:
+				return *static_cast<ChannelIdentifier*>(lhs) == *static_cast<ChannelIdentifier*>(rhs);
+			default:
+				return true;
+	}
 }
 
 size_t ObisIdentifier::unparse(char *buffer, size_t n) {
@@ -226,26 +239,30 @@ size_t ChannelIdentifier::unparse(char *buffer, size_t n) {
 }
 
 /* AddressIdentifier */
-AddressIdentifier::AddressIdentifier(const char *string) {
+AddressIdentifier::AddressIdentifier(const char *string)
+		: ReadingIdentifier(type_address)
+{
 	parse(string);
 }
 
 bool AddressIdentifier::operator==(AddressIdentifier &cmp) {
-	return (_address == cmp._address);
+	return (_address == cmp._address && _slave == cmp._slave);
 }
 
 void AddressIdentifier::parse(const char *string) {
-	int ret;
-	unsigned int address;
-	ret = sscanf(string, "address%u", &address);
-	if (ret != 1) {
+	unsigned int address, slave = 0;
+	if (sscanf(string, "address%u", &address) != 1 &&
+			sscanf(string, "slave%u/address%u", &slave, &address) != 2) {
 		throw vz::VZException("Failed to parse address identifier");
 	}
 	_address = address;
-
+	_slave = slave;
 }
 
 size_t AddressIdentifier::unparse(char *buffer, size_t n) {
+	if (_slave) {
+		return snprintf(buffer, n, "slave%u/address%u", _slave, _address);
+	}
 	return snprintf(buffer, n, "address%u", _address);
 }
 
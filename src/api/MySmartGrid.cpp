@@ -79,28 +79,9 @@ vz::api::MySmartGrid::MySmartGrid(
 		throw;
 	}
 /* parse optional options */
-	try {
-		_interval   = optlist.lookup_int(pOptions, "interval");
-	} catch ( vz::OptionNotFoundException &e ) {
-		_interval = 300;  // default time between 2 logmessages
-	} catch ( vz::VZException &e ) {
-		throw;
-	}
-	try {
-		_scaler   = optlist.lookup_int(pOptions, "scaler");
-	} catch ( vz::OptionNotFoundException &e ) {
-		_scaler   = 1;  // default scaling faktor
-	} catch ( vz::VZException &e ) {
-		throw;
-	}
-
-	try {
-		curlTimeout = optlist.lookup_int(pOptions, "timeout");
-	} catch ( vz::OptionNotFoundException &e ) {
-    curlTimeout = 30; // use default value instead
-  } catch ( vz::VZException &e ) {
-		throw;
-	}
+	_interval   = optlist.lookup_int(pOptions, "interval", 300);  // default time between 2 logmessages
+	_scaler   = optlist.lookup_int(pOptions, "scaler", 1);  // default scaling faktor
+	curlTimeout = optlist.lookup_int(pOptions, "timeout", 30); // use default value instead
 	convertUuid(channel()->uuid());
 
 	switch(_channelType) {
@@ -152,10 +133,10 @@ void vz::api::MySmartGrid::send()
 	CURLcode curl_code;
 
 // check if we want to send
-	time_t now = time(NULL);
+	time_t now = vz::Clock::time();
 
 	if(_first_ts>0) {
-		if ( (now-first_ts()) < interval() ) {
+		if ( (now-first_ts()) < interval() && !channel()->draining() ) {
 			print(log_debug, "api-MySmartGrid, skip message.", "");
 			return;
 		}
@@ -195,10 +176,15 @@ void vz::api::MySmartGrid::send()
 
 /* check response */
 	if (curl_code == CURLE_OK && http_code == 200) { /* everything is ok */
+		double duration;
+		curl_easy_getinfo(_curlIF.handle(), CURLINFO_TOTAL_TIME, &duration);
+
 		print(log_debug, "Request succeeded with code: %i", channel()->name(), http_code);
+		delivered(_values, duration);
 		_values.clear();
 	}
 	else { /* error */
+		failed();
 		channel()->buffer()->undelete();
 		if (curl_code != CURLE_OK) {
 			print(log_error, "CURL: %s", channel()->name(), curl_easy_strerror(curl_code));
@@ -215,10 +201,10 @@ void vz::api::MySmartGrid::send()
 /* householding */
 	json_object_put(json_obj);
 
-	if (options.daemon() && (curl_code != CURLE_OK || http_code != 200)) {
+	if ((options.daemon() || channel()->draining()) && (curl_code != CURLE_OK || http_code != 200)) {
 		print(log_info, "Waiting %i secs for next request due to previous failure",
 					channel()->name(), options.retry_pause());
-		sleep(options.retry_pause());
+		vz::Clock::sleep(options.retry_pause());
 	}
 //sleep(20);
 }
@@ -318,7 +304,7 @@ void vz::api::MySmartGrid::_send(
 	if (options.daemon() && (curl_code != CURLE_OK || http_code != 200)) {
 		print(log_info, "Waiting %i secs for next request due to previous failure",
 					channel()->name(), options.retry_pause());
-		sleep(options.retry_pause());
+		vz::Clock::sleep(options.retry_pause());
 	}
 }
 
@@ -368,10 +354,10 @@ json_object *vz::api::MySmartGrid::_apiDevice(Buffer::Ptr buf) {
 	buf->clean();
 
 	if(_first_ts>0) { // send lifesign
-		_first_ts = time(NULL);
+		_first_ts = vz::Clock::time();
 		return _json_object_heartbeat();
 	} else{ // send  device registration
-		_first_ts = time(NULL);
+		_first_ts = vz::Clock::time();
 		return _json_object_registration();
 	}
 }
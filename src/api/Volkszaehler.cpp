@@ -61,14 +61,7 @@ vz::api::Volkszaehler::Volkszaehler(
 		throw;
 	}
 
-	try {
-		curlTimeout = optlist.lookup_int(pOptions, "timeout");
-	} catch ( vz::OptionNotFoundException &e ) {
-// use default value instead
-    curlTimeout = 30; // 30 seconds
-  } catch ( vz::VZException &e ) {
-		throw;
-	}
+	curlTimeout = optlist.lookup_int(pOptions, "timeout", 30); // 30 seconds
 
 /* prepare header, uuid & url */
 	sprintf(agent, "User-Agent: %s/%s (%s)", PACKAGE, VERSION, curl_version());     /* build user agent */
@@ -132,12 +125,17 @@ void vz::api::Volkszaehler::send()
 
 	/* check response */
 	if (curl_code == CURLE_OK && http_code == 200) { /* everything is ok */
+		double duration;
+		curl_easy_getinfo(curl(), CURLINFO_TOTAL_TIME, &duration);
+
 		print(log_debug, "CURL Request succeeded with code: %i", channel()->name(), http_code);
+		delivered(_values, duration);
 		_values.clear();
 		//clear buffer-readings
 //channel()->buffer.sent = last->next;
 	}
 	else { /* error */
+		failed();
 		if (curl_code != CURLE_OK) {
 			print(log_error, "CURL: %s", channel()->name(), curl_easy_strerror(curl_code));
 		}
@@ -153,10 +151,10 @@ void vz::api::Volkszaehler::send()
 	json_object_put(json_obj);
 
 
-	if (options.daemon() && (curl_code != CURLE_OK || http_code != 200)) {
+	if ((options.daemon() || channel()->draining()) && (curl_code != CURLE_OK || http_code != 200)) {
 		print(log_info, "Waiting %i secs for next request due to previous failure",
 					channel()->name(), options.retry_pause());
-		sleep(options.retry_pause());
+		vz::Clock::sleep(options.retry_pause());
 	}
 }
 
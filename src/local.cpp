@@ -85,36 +85,47 @@ int handle_request(
 				}
 			}
 
+			/* the configuration might be reloaded while we are waiting for comet requests */
+			std::list<std::pair<Channel::Ptr, Meter::Ptr> > channels;
+			mappings->lock();
 			for(MapContainer::iterator mapping = mappings->begin(); mapping!=mappings->end(); mapping++) {
 				for(MeterMap::iterator ch = mapping->begin(); ch!=mapping->end(); ch++) {
+					channels.push_back(std::make_pair(*ch, mapping->meter()));
+				}
+			}
+			mappings->unlock();
+
+			for(std::list<std::pair<Channel::Ptr, Meter::Ptr> >::iterator it = channels.begin(); it!=channels.end(); it++) {
+				Channel::Ptr ch = it->first;
+				Meter::Ptr meter = it->second;
 //foreach(mapping->channels, ch, channel_t) {
-					if (strcmp((*ch)->uuid(), uuid) == 0 || show_all) {
-						response_code = MHD_HTTP_OK;
+				if (strcmp(ch->uuid(), uuid) == 0 || show_all) {
+					response_code = MHD_HTTP_OK;
 
 /* blocking until new data arrives (comet-like blocking of HTTP response) */
-						if (mode && strcmp(mode, "comet") == 0) {
+					if (mode && strcmp(mode, "comet") == 0) {
 /* convert from timeval to timespec */
-							gettimeofday(&tp, NULL);
-							ts.tv_sec  = tp.tv_sec + options.comet_timeout();
-							ts.tv_nsec = tp.tv_usec * 1000;
+						gettimeofday(&tp, NULL);
+						ts.tv_sec  = tp.tv_sec + options.comet_timeout();
+						ts.tv_nsec = tp.tv_usec * 1000;
 
-							(*ch)->wait();
-						}
+						ch->wait();
+					}
 
-						struct json_object *json_ch = json_object_new_object();
+					struct json_object *json_ch = json_object_new_object();
 
-						json_object_object_add(json_ch, "uuid", json_object_new_string((*ch)->uuid()));
+					json_object_object_add(json_ch, "uuid", json_object_new_string(ch->uuid()));
 //json_object_object_add(json_ch, "middleware", json_object_new_string(ch->middleware()));
 //json_object_object_add(json_ch, "last", json_object_new_double(ch->last.value));
-						json_object_object_add(json_ch, "last", json_object_new_double((*ch)->tvtod()));
-						json_object_object_add(json_ch, "interval", json_object_new_int(mapping->meter()->interval()));
-						json_object_object_add(json_ch, "protocol", json_object_new_string(meter_get_details(mapping->meter()->protocolId())->name));
+					json_object_object_add(json_ch, "last", json_object_new_double(ch->tvtod()));
+					json_object_object_add(json_ch, "interval", json_object_new_double(meter->interval()));
+					json_object_object_add(json_ch, "stale", json_object_new_double(meter->stale()));
+					json_object_object_add(json_ch, "protocol", json_object_new_string(meter_get_details(meter->protocolId())->name));
 
 //struct json_object *json_tuples = api_json_tuples(&ch->buffer, ch->buffer.head, ch->buffer.tail);
 //json_object_object_add(json_ch, "tuples", json_tuples);
 
-						json_object_array_add(json_data, json_ch);
-					}
+					json_object_array_add(json_data, json_ch);
 				}
 			}
 
@@ -0,0 +1,257 @@
+/**
+ * Precompiled line formats for text based protocols
+ *
+ * @package vzlogger
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @license http://www.gnu.org/licenses/gpl.txt GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+
+#include "protocols/LineFormat.hpp"
+#include <common.h>
+#include <VZException.hpp>
+
+#define LINE_FORMAT_MAX_IDENTIFIERS 1024 /* stop interning to limit memory usage */
+
+/* exactly representable powers of ten */
+static const double pow10_table[] = {
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+LineFormat::LineFormat()
+		: _default_id(new StringIdentifier(""))
+{
+	compile(NULL);
+}
+
+void LineFormat::compile(const char *format) {
+	bool has_value = false;
+	std::string literal;
+
+	_program.clear();
+	_literals.clear();
+	_format = (format != NULL && *format != '\0') ? format : "$v";
+
+	for (const char *p = _format.c_str(); *p; p++) {
+		token_t token;
+
+		if (isspace(*p)) {
+			while (isspace(*(p+1))) p++; /* collapse whitespaces */
+			token.op = op_space;
+		}
+		else if (*p == '$' && *(p+1) != '$') {
+			switch (*(++p)) {
+					case 'v': token.op = op_value; has_value = true; break;
+					case 'i': token.op = op_identifier; break;
+					case 't': token.op = op_timestamp; break;
+					default:
+						print(log_error, "Invalid token '$%c' in format \"%s\"", "file", *p, _format.c_str());
+						throw vz::VZException("Invalid token in format");
+			}
+		}
+		else {
+			if (*p == '$') p++; /* "$$" is an escaped "$" */
+			literal += *p;
+
+			/* merge consecutive characters into a single literal */
+			if (*(p+1) != '\0' && !isspace(*(p+1)) && (*(p+1) != '$' || *(p+2) == '$')) continue;
+
+			token.op = op_literal;
+			token.arg = _literals.size();
+			_literals.push_back(literal);
+			literal.clear();
+		}
+
+		_program.push_back(token);
+	}
+
+	if (!has_value) {
+		print(log_error, "Format \"%s\" has no value token ($v)", "file", _format.c_str());
+		throw vz::VZException("Missing value in format");
+	}
+}
+
+bool LineFormat::parse(const char *line, Reading &rd) {
+	ReadingIdentifier::Ptr id = _default_id;
+	double value = 0, timestamp = 0;
+	bool has_value = false, has_timestamp = false;
+	const char *p = line, *end;
+
+	for (size_t pc = 0; pc < _program.size(); pc++) {
+		const token_t &token = _program[pc];
+
+		switch (token.op) {
+				case op_literal: {
+					const std::string &literal = _literals[token.arg];
+					if (strncmp(p, literal.c_str(), literal.length()) != 0) goto done;
+					p += literal.length();
+					break;
+				}
+
+				case op_space:
+					while (isspace(*p)) p++;
+					break;
+
+				case op_value:
+				case op_timestamp: {
+					while (isspace(*p)) p++;
+					double v = parse_double(p, &end);
+					if (end == p) goto done;
+
+					if (token.op == op_value) {
+						value = v;
+						has_value = true;
+					}
+					else {
+						timestamp = v;
+						has_timestamp = true;
+					}
+					p = end;
+					break;
+				}
+
+				case op_identifier: {
+					/* an identifier ends at a whitespace or where the next literal starts */
+					char stop = (pc+1 < _program.size() && _program[pc+1].op == op_literal) ?
+						_literals[_program[pc+1].arg][0] : '\0';
+
+					while (isspace(*p)) p++;
+					for (end = p; *end && !isspace(*end) && *end != stop; end++);
+					if (end == p) goto done;
+
+					id = _intern(p, end - p);
+					p = end;
+					break;
+				}
+		}
+	}
+
+	done:
+	if (!has_value) {
+		return false;
+	}
+
+	rd.value(value);
+	rd.identifier(id);
+	if (has_timestamp) {
+		struct timeval tv = rd.dtotv(timestamp);
+		rd.time(tv);
+	}
+	else {
+		rd.time();
+	}
+
+	return true;
+}
+
+double LineFormat::parse_double(const char *str, const char **end) {
+	const char *p = str;
+	uint64_t mantissa = 0;
+	int digits = 0, exponent = 0;
+	bool negative = false, any = false;
+
+	if (*p == '+' || *p == '-') {
+		negative = (*p == '-');
+		p++;
+	}
+
+	for (; isdigit(*p); p++, any = true) {
+		if (digits < 19) {
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa) digits++;
+		}
+		else {
+			exponent++; /* ignore insignificant digits */
+		}
+	}
+
+	if (*p == '.') {
+		for (p++; isdigit(*p); p++, any = true) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa) digits++;
+				exponent--;
+			}
+		}
+	}
+
+	if (any && (*p == 'e' || *p == 'E')) {
+		const char *q = p + 1;
+		bool negative_exp = false;
+		int exp = 0;
+
+		if (*q == '+' || *q == '-') {
+			negative_exp = (*q == '-');
+			q++;
+		}
+
+		if (isdigit(*q)) {
+			for (; isdigit(*q); q++) {
+				if (exp < 10000) exp = exp * 10 + (*q - '0');
+			}
+			exponent += negative_exp ? -exp : exp;
+			p = q;
+		}
+	}
+
+	/* fast path: mantissa and power of ten are exact doubles */
+	if (any && digits <= 15 && exponent >= -22 && exponent <= 22) {
+		double value = (double) mantissa;
+		value = (exponent < 0) ? value / pow10_table[-exponent] : value * pow10_table[exponent];
+
+		*end = p;
+		return negative ? -value : value;
+	}
+
+	/* slow path: everything else (long mantissas, huge exponents, inf, nan) */
+	char *endptr;
+	double value = strtod(str, &endptr);
+	*end = endptr;
+
+	return value;
+}
+
+ReadingIdentifier::Ptr LineFormat::_intern(const char *str, size_t len) {
+	unsigned int hash = 2166136261u; /* FNV-1a */
+	for (size_t i = 0; i < len; i++) {
+		hash = (hash ^ (unsigned char) str[i]) * 16777619u;
+	}
+
+	for (std::vector<intern_t>::const_iterator it = _identifiers.begin(); it != _identifiers.end(); it++) {
+		if (it->hash == hash && it->str.compare(0, std::string::npos, str, len) == 0) {
+			return it->id;
+		}
+	}
+
+	ReadingIdentifier::Ptr id(new StringIdentifier(std::string(str, len)));
+	if (_identifiers.size() < LINE_FORMAT_MAX_IDENTIFIERS) {
+		intern_t entry;
+		entry.hash = hash;
+		entry.str.assign(str, len);
+		entry.id = id;
+		_identifiers.push_back(entry);
+	}
+
+	return id;
+}
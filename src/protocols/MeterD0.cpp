@@ -68,6 +68,8 @@ MeterD0::MeterD0(std::list<Option> options)
 		throw;
 	}
 
+	_timeout = optlist.lookup_int(options, "timeout", PROTOCOL_CONNECT_TIMEOUT);
+
 	/* baudrate */
 	int baudrate = 9600; /* default to avoid compiler warning */
 	try {
@@ -105,11 +107,12 @@ int MeterD0::open() {
 		_fd = _openDevice(&_oldtio, _baudrate);
 	}
 	else if (_host != "") {
-		char *addr = strdup(host());
+		char *copy = strdup(host()), *addr = copy;
 		const char *node = strsep(&addr, ":");
 		const char *service = strsep(&addr, ":");
 
-		_fd = _openSocket(node, service);
+		_fd = connect(node, service, _timeout);
+		free(copy);
 	}
 
 	return (_fd < 0) ? ERR : SUCCESS;
@@ -155,12 +158,20 @@ ssize_t MeterD0::read(std::vector<Reading>&rds, size_t max_readings) {
 	char byte;			/* we parse our input byte wise */
 	int byte_iterator; 
 	size_t number_of_tuples;
+	ssize_t bytes;
 
 	byte_iterator =  number_of_tuples = baudrate = 0;
 
 	context = START;				/* start with context START */
 
-	while (::read(_fd, &byte, 1)) {
+	/* without a deadline the blocking read() alone detects the hangup, spare a poll() per byte */
+	while ((deadline() < 0 || readable(_fd)) && (bytes = ::read(_fd, &byte, 1)) != 0) {
+		if (bytes < 0) {
+			if (lost(bytes)) return 0;
+			continue;
+		}
+
+		received(1);
 		if (byte == '/') context = START; 	/* reset to START if "/" reoccurs */
 		else if (byte == '!') context = END;	/* "!" is the identifier for the END */
 		switch (context) {
@@ -273,40 +284,21 @@ ssize_t MeterD0::read(std::vector<Reading>&rds, size_t max_readings) {
 					}
 					print(log_debug, "Read package with %i tuples (vendor=%s, baudrate=%c, identification=%s)",
 								name().c_str(), number_of_tuples, vendor, baudrate, identification);
+					parsed();
 					return number_of_tuples;
 		}
 	}
+	if (connected()) {
+		lost(bytes); /* end of file */
+	}
+	return 0;
 
 	error:
 	print(log_error, "Something unexpected happened: %s:%i!", name().c_str(), __FUNCTION__, __LINE__);
+	parsed(false);
 	return 0;
 }
 
-int MeterD0::_openSocket(const char *node, const char *service) {
-	struct sockaddr_in sin;
-	struct addrinfo *ais;
-	int fd; /* file descriptor */
-	int res;
-
-	fd = socket(PF_INET, SOCK_STREAM, 0);
-	if (fd < 0) {
-		print(log_error, "socket(): %s", name().c_str(), strerror(errno));
-		return ERR;
-	}
-
-	getaddrinfo(node, service, NULL, &ais);
-	memcpy(&sin, ais->ai_addr, ais->ai_addrlen);
-	freeaddrinfo(ais);
-
-	res = connect(fd, (struct sockaddr *) &sin, sizeof(sin));
-	if (res < 0) {
-		print(log_error, "connect(%s, %s): %s", name().c_str(), node, service, strerror(errno));
-		return ERR;
-	}
-
-	return fd;
-}
-
 int MeterD0::_openDevice(struct termios *old_tio, speed_t baudrate) {
 	struct termios tio;
 	memset(&tio, 0, sizeof(struct termios));
@@ -317,6 +309,12 @@ int MeterD0::_openDevice(struct termios *old_tio, speed_t baudrate) {
 		return ERR;
 	}
 
+	_tty = isatty(fd);
+	if (!_tty) {
+		print(log_debug, "%s is not a tty, skipping serial configuration", name().c_str(), device());
+		return fd;
+	}
+
 	/* get old configuration */
 	tcgetattr(fd, &tio) ;
 
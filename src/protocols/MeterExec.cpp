@@ -24,58 +24,270 @@
  */
 
 #include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
 #include <sys/time.h>
 
 #include "protocols/MeterExec.hpp"
 #include "Options.hpp"
 #include <VZException.hpp>
 
+extern char **environ;
+
 MeterExec::MeterExec(std::list<Option> options) 
 		: Protocol("exec")
+		, _persistent(false)
+		, _pid(0)
+		, _fd(-1)
+		, _eof(false)
+		, _len(0)
 {
 	OptionList optlist;
 
 	try {
 		_command = optlist.lookup_string(options, "command");
 	} catch( vz::VZException &e ) {
-		print(log_error, "Missing command or invalid type", "");
+		print(log_error, "Missing command or invalid type", name().c_str());
 		throw;
 	}
 
 	try {
-		_format = optlist.lookup_string(options, "format");
+		_format.compile(optlist.lookup_string(options, "format"));
 	} catch( vz::OptionNotFoundException &e ) {
-		_format = NULL; /* use default format */
+		/* use default format: just reading a value per line */
+	} catch( vz::VZException &e ) {
+		print(log_error, "Failed to parse format", name().c_str());
+		throw;
+	}
+
+	/* keep the program running and read its output continously? */
+	try {
+		_persistent = optlist.lookup_bool(options, "persistent", false); /* spawn the program for each reading by default */
 	} catch( vz::VZException &e ) {
-		print(log_error, "Failed to parse format", "");
+		print(log_error, "Invalid type for 'persistent'", name().c_str());
 		throw;
 	}
 }
 
 MeterExec::~MeterExec() {
-
-	free((void*)_command);
-
-	if (_format != NULL) {
-		free((void*)_format);
+	if (_pid > 0 || _fd >= 0) {
+		_reap(SIGTERM);
 	}
 }
 
 int MeterExec::open() {
+	if (_persistent) {
+		return _spawn();
+	}
 
-	// TODO implement
-	return ERR;
+	return SUCCESS; /* the program is started by read() */
 }
 
 int MeterExec::close() {
+	_reap(SIGTERM);
 
-	// TODO implement
-	return ERR;
+	return SUCCESS;
 }
 
 ssize_t MeterExec::read(std::vector<Reading> &rds, size_t n) {
-	//meter_handle_exec_t *handle = &mtr->handle.exec;
+	size_t i = 0;
+
+	if (_fd < 0 && _spawn() != SUCCESS) {
+		return 0;
+	}
+
+	if (_persistent) {
+		/* consume lines left over from the last call */
+		i = _parse_lines(rds, i, n);
+
+		/* block until the program sent at least one reading */
+		while (i == 0 && !_eof) {
+			_fill(-1); /* sets _eof on errors, the program is respawned below */
+			i = _parse_lines(rds, i, n);
+		}
+
+		/* take whatever is available without blocking */
+		while (i < n && !_eof && _fill(0) > 0) {
+			i = _parse_lines(rds, i, n);
+		}
+
+		if (_eof) {
+			print(log_warning, "Program '%s' terminated, restarting with next reading", name().c_str(), command());
+			_reap(0);
+
+			if (i == 0) sleep(1); /* do not respawn a failing program in a tight loop */
+		}
+	}
+	else {
+		/* read the complete output of the program */
+		while (!_eof && _fill(-1) >= 0) {
+			i = _parse_lines(rds, i, n);
+			if (i == n) _len = 0; /* discard surplus output */
+		}
+
+		_reap(0);
+	}
+
+	return i;
+}
+
+int MeterExec::_spawn() {
+	int pipefd[2];
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	sigset_t mask, defaults;
+	const char *argv[] = { "sh", "-c", command(), NULL };
+
+	if (pipe(pipefd) < 0) {
+		print(log_error, "pipe(): %s", name().c_str(), strerror(errno));
+		return ERR;
+	}
+
+	fcntl(pipefd[0], F_SETFD, FD_CLOEXEC);
+	fcntl(pipefd[1], F_SETFD, FD_CLOEXEC); /* dup2() below clears the flag for stdout */
+
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, pipefd[1], STDOUT_FILENO);
+
+	/* the daemon blocks the termination signals in all threads and ignores others, the program must not inherit that */
+	sigemptyset(&mask);
+	sigemptyset(&defaults);
+	sigaddset(&defaults, SIGINT);
+	sigaddset(&defaults, SIGHUP);
+	sigaddset(&defaults, SIGTERM);
+	sigaddset(&defaults, SIGPIPE);
+	sigaddset(&defaults, SIGCHLD);
+	sigaddset(&defaults, SIGTSTP);
+	sigaddset(&defaults, SIGTTOU);
+	sigaddset(&defaults, SIGTTIN);
+
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	posix_spawnattr_setsigdefault(&attr, &defaults);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+	int rc = posix_spawn(&_pid, "/bin/sh", &actions, &attr, (char * const *) argv, environ);
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+	::close(pipefd[1]);
+
+	if (rc != 0) {
+		print(log_error, "posix_spawn(%s): %s", name().c_str(), command(), strerror(rc));
+		::close(pipefd[0]);
+		_pid = 0;
+		return ERR;
+	}
+
+	print(log_debug, "Started '%s' (pid=%d)", name().c_str(), command(), _pid);
+
+	_fd = pipefd[0];
+	_eof = false;
+	_len = 0;
+
+	return SUCCESS;
+}
+
+void MeterExec::_reap(int sig) {
+	int status;
+
+	if (_fd >= 0) {
+		::close(_fd);
+		_fd = -1;
+	}
+
+	if (_pid > 0) {
+		if (sig) kill(_pid, sig);
+
+		/* do not hang on a program which ignores the signal or keeps running after closing stdout */
+		pid_t rc;
+		int waited = 0;
+		while ((rc = waitpid(_pid, &status, WNOHANG)) == 0 || (rc < 0 && errno == EINTR)) {
+			if (waited >= EXEC_KILL_TIMEOUT) {
+				print(log_warning, "Program '%s' did not terminate, killing it", name().c_str(), command());
+				kill(_pid, SIGKILL);
+				rc = waitpid(_pid, &status, 0);
+				break;
+			}
+			usleep(10000);
+			waited += 10;
+		}
+
+		/* SIGCHLD might be ignored when running as daemon: children are reaped automatically */
+		if (rc == _pid && WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+			print(log_warning, "Program '%s' exited with status %d", name().c_str(), command(), WEXITSTATUS(status));
+		}
+		_pid = 0;
+	}
+}
+
+ssize_t MeterExec::_fill(int timeout) {
+	struct pollfd pfd;
+	pfd.fd = _fd;
+	pfd.events = POLLIN;
+
+	int rc = poll(&pfd, 1, timeout);
+	if (rc < 0) {
+		if (errno == EINTR) return 0;
+		print(log_error, "poll(): %s", name().c_str(), strerror(errno));
+		_eof = true; /* respawn instead of polling the broken pipe again */
+		return ERR;
+	}
+	else if (rc == 0) {
+		return 0; /* timeout */
+	}
+
+	if (_len == EXEC_BUFFER_LEN) { /* line too long: pass it as it is */
+		_buffer[EXEC_BUFFER_LEN-1] = '\n';
+		return 1;
+	}
+
+	ssize_t bytes = ::read(_fd, _buffer + _len, EXEC_BUFFER_LEN - _len);
+	if (bytes < 0) {
+		if (errno == EINTR || errno == EAGAIN) return 0;
+		print(log_error, "read(): %s", name().c_str(), strerror(errno));
+		_eof = true;
+		return ERR;
+	}
+	else if (bytes == 0) {
+		_eof = true;
+
+		if (_len > 0 && _len < EXEC_BUFFER_LEN) { /* terminate last line */
+			_buffer[_len++] = '\n';
+		}
+	}
+
+	received(bytes);
+	_len += bytes;
+	return bytes;
+}
+
+size_t MeterExec::_parse_lines(std::vector<Reading> &rds, size_t i, size_t n) {
+	char *start = _buffer, *nl;
+
+	while (i < n && (nl = (char *) memchr(start, '\n', _len - (start - _buffer))) != NULL) {
+		*nl = '\0';
+		if (nl > start && *(nl-1) == '\r') *(nl-1) = '\0';
+
+		if (_format.parse(start, rds[i])) {
+			i++; /* read successfully */
+			parsed();
+		}
+		else if (*start != '\0') {
+			print(log_debug, "Skipping line: '%s'", name().c_str(), start);
+			parsed(false);
+		}
+
+		start = nl + 1;
+	}
+
+	/* move remaining bytes to the front */
+	_len -= start - _buffer;
+	memmove(_buffer, start, _len);
 
-	// TODO implement
-	return 0;
+	return i;
 }
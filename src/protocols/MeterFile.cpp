@@ -32,6 +32,9 @@
 #include "Options.hpp"
 #include <VZException.hpp>
 
+#define FILE_LINE_LEN 256
+#define FILE_BUFFER_LEN 65536
+
 MeterFile::MeterFile(std::list<Option> options)
 		: Protocol("file")
 {
@@ -44,53 +47,14 @@ MeterFile::MeterFile(std::list<Option> options)
 		throw;
 	}
 
-	/* a optional format string for scanf() */
+	/* a optional format string, compiled once into a token program */
 	try {
 		const char *config_format = optlist.lookup_string(options, "format");
 
-		/**
-		 * Compiling the provided format string in a format string for scanf
-		 * by replacing the following tokens
-		 *
-		 * "$v" => "%1$f" (value)
-		 * "$i" => "%2$ms" (identifier)		(memory gets allocated by sscanf())
-		 * "$t" => "%3$f" (timestamp)
-		 */
-
-		int config_len = strlen(config_format);
-		int scanf_len = config_len + 8; /* adding extra space for longer conversion specification in scanf_format */
-
-		char *scanf_format = (char *)malloc(scanf_len); /* the scanf format string */
-
-		int i = 0; /* index in config_format string */
-		int j = 0; /* index in scanf_format string */
-		while (i <= config_len && j <= scanf_len) {
-			switch (config_format[i]) {
-					case '$':
-						if (i+1 < config_len) { /* introducing a token */
-							switch (config_format[i+1]) {
-									case 'v': j += sprintf(scanf_format+j, "%%1$f"); break;
-									case 'i': j += sprintf(scanf_format+j, "%%2$ms"); break;
-									case 't': j += sprintf(scanf_format+j, "%%3$lf"); break;
-							}
-							i++;
-						}
-						break;
-
-					case '%':
-						scanf_format[j++] = '%'; /* add double %% to escape a conversion identifier */
-
-					default:
-						scanf_format[j++] = config_format[i]; /* just copying */
-			}
-
-			i++;
-		}
-
-		print(log_debug, "Parsed format string \"%s\" => \"%s\"", name().c_str(), config_format, scanf_format);
-		_format = scanf_format;
+		_format.compile(config_format);
+		print(log_debug, "Parsed format string \"%s\"", name().c_str(), config_format);
 	} catch( vz::OptionNotFoundException &e ) {
-		_format = ""; /* use default format */
+		/* use default format: just reading a value per line */
 	} catch( vz::VZException &e ) {
 		print(log_error, "Failed to parse format", name().c_str());
 		throw;
@@ -99,9 +63,7 @@ MeterFile::MeterFile(std::list<Option> options)
 	/* should we start each time at the beginning of the file? */
 	/* or do we read from a logfile (append) */
 	try {
-		_rewind = optlist.lookup_bool(options, "rewind");
-	} catch( vz::OptionNotFoundException &e ) {
-		_rewind = FALSE; /* do not rewind file by default */
+		_rewind = optlist.lookup_bool(options, "rewind", FALSE); /* do not rewind file by default */
 	} catch( vz::InvalidTypeException &e ) {
 		print(log_error, "Invalid type for 'rewind'", name().c_str());
 		throw;
@@ -123,6 +85,9 @@ int MeterFile::open() {
 		return ERR;
 	}
 
+	/* larger stdio buffer for bulk reading of huge logfiles */
+	setvbuf(_fd, NULL, _IOFBF, FILE_BUFFER_LEN);
+
 	return SUCCESS;
 }
 
@@ -135,9 +100,8 @@ ssize_t MeterFile::read(std::vector<Reading> &rds, size_t n) {
 	
 	// TODO use inotify to block eading until file changes
 
-	char line[256], *endptr;
-	char string[256];
-	
+	char line[FILE_LINE_LEN];
+
 	/* reset file pointer to beginning of file */
 	if (_rewind) {
 		rewind(_fd);
@@ -145,40 +109,21 @@ ssize_t MeterFile::read(std::vector<Reading> &rds, size_t n) {
 
 	unsigned int i = 0;
 	print(log_debug, "MeterFile::read: %d, %d", "", rds.size(), n);
-	
-	while (fgets(line, 256, _fd) && i < n) {
+
+	while (i < n && fgets(line, FILE_LINE_LEN, _fd)) {
+		received(strlen(line));
+
 		char *nl;
 		if ((nl = strrchr(line, '\n'))) *nl = '\0'; /* remove trailing newline */
 		if ((nl = strrchr(line, '\r'))) *nl = '\0';
 
-		if (_format != "") {
-			double timestamp;
-
-			/* at least the value has to been read */
-			double value;
-	
-			print(log_debug, "MeterFile::read: '%s'", "", line);
-			int found = sscanf(line, format(), &value, string, &timestamp);
-			print(log_debug, "MeterFile::read: %f, %s, %ld", "", value, string, timestamp);
-	
-
-			rds[i].value(value);
-			ReadingIdentifier *rid(new StringIdentifier(string));
-			rds[i].identifier(rid);
-			if (found >= 1) { // TODO free() space allocated for identifier string
-				rds[i].dtotv(timestamp); /* convert double to timeval */
-				i++; /* read successfully */
-			}
+		if (_format.parse(line, rds[i])) {
+			i++; /* read successfully */
+			parsed();
 		}
-		else { /* just reading a value per line */
-			rds[i].value(strtod(line, &endptr));
-			rds[i].time();
-			ReadingIdentifier* rid(new StringIdentifier(""));
-			rds[i].identifier(rid);
-
-			if (endptr != line) {
-				i++; /* read successfully */
-			}
+		else {
+			print(log_debug, "Skipping line: '%s'", name().c_str(), line);
+			parsed(false);
 		}
 	}
 
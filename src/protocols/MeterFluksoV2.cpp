@@ -43,7 +43,7 @@ MeterFluksoV2::MeterFluksoV2(std::list<Option> options)
 	try {
 		_fifo = optlist.lookup_string(options, "fifo");
 	} catch( vz::OptionNotFoundException &e ) {
-		_fifo = strdup(FLUKSOV2_DEFAULT_FIFO); /* use default path */
+		_fifo = FLUKSOV2_DEFAULT_FIFO; /* use default path */
 	} catch( vz::VZException &e ) {
 		print(log_error, "Failed to parse fifo", name().c_str());
 		throw;
@@ -51,17 +51,15 @@ MeterFluksoV2::MeterFluksoV2(std::list<Option> options)
 }
 
 MeterFluksoV2::~MeterFluksoV2() {
-
-	//free((void *)_fifo);
 }
 
 int MeterFluksoV2::open() {
 
 	/* open port */
-	_fd = ::open(_fifo, O_RDONLY); 
+	_fd = ::open(_fifo.c_str(), O_RDONLY); 
 
 	if (_fd < 0) {
-		print(log_error, "open(%s): %s", name().c_str(), _fifo, strerror(errno));
+		print(log_error, "open(%s): %s", name().c_str(), _fifo.c_str(), strerror(errno));
 		return ERR;
 	}
 
@@ -82,12 +80,14 @@ ssize_t MeterFluksoV2::read(std::vector<Reading> &rds, size_t n) {
 	char *cursor = line;	/* moving cursor for strsep() */
 
 	do {
-		bytes = _read_line(_fd, line, 64); /* blocking read of a complete line */
+		bytes = _read_line(_fd, line, sizeof(line) - 1); /* blocking read of a complete line */
 		if (bytes < 0) {
-			print(log_error, "read_line(%s): %s", name().c_str(), _fifo, strerror(errno));
-			return bytes; /* an error occured, pass through to caller */
+			return 0; /* the connection has been lost */
 		}
 	} while (bytes == 0);
+	line[bytes] = '\0';
+	received(bytes + 1);
+	parsed();
 
 
 	char *time_str = strsep(&cursor, " \t"); /* first token is the timestamp */
@@ -95,21 +95,21 @@ ssize_t MeterFluksoV2::read(std::vector<Reading> &rds, size_t n) {
 	time.tv_sec = strtol(time_str, NULL, 10);
 	time.tv_usec = 0; /* no millisecond resolution available */
 
-	while (cursor) {
+	while (cursor && i + 2 <= n) {
 		int channel = atoi(strsep(&cursor, " \t")) + 1; /* increment by 1 to distinguish between +0 and -0 */
 
 		/* consumption - gets negative channel id as identifier! */
 		ReadingIdentifier *rid1(new ChannelIdentifier(-channel)); 
 		rds[i].time(time);
 		rds[i].identifier(rid1);
-		rds[i].value(atoi(strsep(&cursor, " \t")));
+		rds[i].value(atoi(cursor ? strsep(&cursor, " \t") : "0"));
 		i++;
 
 		/* power - gets positive channel id as identifier! */
 		ReadingIdentifier *rid2(new ChannelIdentifier(channel)); 
 		rds[i].time(time);
 		rds[i].identifier(rid2);
-		rds[i].value(atoi(strsep(&cursor, " \t")));
+		rds[i].value(atoi(cursor ? strsep(&cursor, " \t") : "0"));
 		i++;
 	}
 
@@ -133,8 +133,8 @@ ssize_t MeterFluksoV2::_read_line(int fd, char  *buffer, size_t n) {
 						buffer[i++] = c;
 			}
 		}
-		else if (r < 0) { /* an error occured, pass through to caller */
-			return r;
+		else if (lost(r)) { /* end of file or an error, pass through to caller */
+			return -1;
 		}
 	}
 
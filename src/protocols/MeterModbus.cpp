@@ -25,12 +25,16 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
+#include <time.h>
 #include <errno.h>
 #include <math.h>
+#include <ctype.h>
+#include <algorithm>
 
 #include <protocols/MeterModbus.hpp>
-#include <protocols/expression_parser.hpp>
+#include <protocols/ModbusConnection.hpp>
 #include <VZException.hpp>
 #include <inttypes.h>
 
@@ -41,44 +45,111 @@ MeterModbus::MeterModbus(std::list<Option> options)
 		: Protocol("modbus")
 {
 	OptionList optlist;
+
+	/* connection */
 	try {
 		_ip = optlist.lookup_string(options, "ip");
+	} catch( vz::OptionNotFoundException &e ) {
+		try {
+			_device = optlist.lookup_string(options, "device");
+		} catch( vz::VZException &e ) {
+			print(log_error, "Missing IP or device", name().c_str());
+			throw;
+		}
 	} catch( vz::VZException &e ) {
 		print(log_error, "Missing IP or invalid type", name().c_str());
 		throw;
 	}
+
+	if (_device == "") {
+		try {
+			 _port = optlist.lookup_int(options, "port");
+		} catch( vz::VZException &e ) {
+			print(log_error, "Missing Port or invalid type", name().c_str());
+			_port = MODBUS_TCP_DEFAULT_PORT;
+		}
+	}
+	else {
+		_baudrate = optlist.lookup_int(options, "baudrate", 9600);
+		try {
+			const char *parity = optlist.lookup_string(options, "parity");
+			_parity = toupper(parity[0]);
+			if (_parity != 'N' && _parity != 'E' && _parity != 'O') {
+				print(log_error, "Invalid parity: %s", name().c_str(), parity);
+				throw vz::VZException("Invalid parity");
+			}
+		} catch( vz::OptionNotFoundException &e ) {
+			_parity = 'N';
+		}
+		_databits = optlist.lookup_int(options, "databits", 8);
+		_stopbits = optlist.lookup_int(options, "stopbits", 1);
+	}
+
+	_slave = optlist.lookup_int(options, "slave", (_device == "") ? MODBUS_TCP_SLAVE : 1);
+	_timeout = optlist.lookup_int(options, "timeout", MODBUS_DEFAULT_TIMEOUT);
+	_backoff = optlist.lookup_int(options, "backoff", MODBUS_DEFAULT_BACKOFF);
+	_pipeline = optlist.lookup_int(options, "pipeline", 1);
+	_interval = optlist.lookup_double(options, "interval", 0);
+	if (_pipeline < 1 || (_pipeline > 1 && _device != "")) {
+		print(log_error, "Pipelining needs a depth >= 1 and is only available via TCP", name().c_str());
+		throw vz::VZException("Invalid pipeline depth");
+	}
 	try {
-		 _port = optlist.lookup_int(options, "port");
+		_max_gap = optlist.lookup_int(options, "max_gap", MODBUS_DEFAULT_MAX_GAP);
 	} catch( vz::VZException &e ) {
-		print(log_error, "Missing Port or invalid type", name().c_str());
-		_port = MODBUS_TCP_DEFAULT_PORT;
+		print(log_error, "Invalid type for max_gap", name().c_str());
+		throw;
 	}
+	if (_max_gap < 0) {
+		print(log_error, "max_gap must not be negative", name().c_str());
+		throw vz::VZException("Invalid max_gap");
+	}
+	_stats_interval = optlist.lookup_int(options, "statistics", 0); /* 0 disables the reports */
+	memset(&_poll_stats, 0, sizeof(_poll_stats));
+	clock_gettime(CLOCK_MONOTONIC, &_stats_time);
 	
 	//Copy over the addressparams for clean memory management
-	struct addressparam *addresses = (struct addressparam *)optlist.lookup_addressparams(options, "addresses");
-	struct addressparam *addressptr = addresses;
-	_addressparams = addresses;
-	
-	//addressptr = _addressparams;
-	
+	const struct addressparam *addresses = optlist.lookup_addressparams(options, "addresses");
+	size_t count = 0;
+	while (addresses[count].function_code != 0xFF) {
+		count++;
+	}
+	_addressparams = new struct addressparam[count + 1];
+	std::copy(addresses, addresses + count + 1, _addressparams);
+	struct addressparam *addressptr = _addressparams;
+
 	while(addressptr->function_code != 0xFF){
 		unsigned int length = strlen(addressptr->recalc_str);
 		char *str_mem;
 		str_mem = new char[length+1];
 		strncpy(str_mem, addressptr->recalc_str, length+1);
 		addressptr->recalc_str = str_mem;
+		if (addressptr->type != NULL) {
+			addressptr->type = strdup(addressptr->type);
+		}
 		print(log_debug, "Got Addressparam: %u, %u, %s", name().c_str(), addressptr->function_code, addressptr->address, addressptr->recalc_str);
 		addressptr++;
 	}
-	
-	
+
+	_prepare();
+	_tick = 0;
+	_scheduled = 0;
+
+	/* meters on the same gateway or serial line share the connection */
+	if (_device != "") {
+		_connection = ModbusConnection::rtu(_device, _baudrate, _parity, _databits, _stopbits);
+	}
+	else {
+		_connection = ModbusConnection::tcp(_ip, _port);
+	}
 }
 
 MeterModbus::~MeterModbus() {
-	if(!_reset_connection){
-		modbus_close(_mb);
-		modbus_free(_mb);
+	for (struct addressparam *p = _addressparams; p->function_code != 0xFF; p++) {
+		delete[] p->recalc_str;
+		free((void *) p->type);
 	}
+	delete[] _addressparams;
 }
 
 void MeterModbus::getHighestDigit(unsigned int number, unsigned char *digit, unsigned char *power){
@@ -92,110 +163,463 @@ void MeterModbus::getHighestDigit(unsigned int number, unsigned char *digit, uns
 	(*power)--;
 }
 
-int MeterModbus::open() {
-	_mb = NULL;
-	_mb = modbus_new_tcp(ip(), _port);
-	
-	if (_mb == NULL) {
-		print(log_error, "Unable to allocate libmodbus context: %s, %i", ip(), _port);
-		return ERR;
+bool MeterModbus::_compare(const reg_t &a, const reg_t &b) {
+	if (a.slave != b.slave) {
+		return a.slave < b.slave;
 	}
-	print(log_debug, "Connecting to %s:%i", name().c_str(), _ip.c_str(), _port);
-	if (modbus_connect(_mb) == -1) {
-		print(log_error, "Connection failed: %s",name().c_str(), modbus_strerror(errno));
-		modbus_free(_mb);
-		return ERR;
+	if (a.param->function_code != b.param->function_code) {
+		return a.param->function_code < b.param->function_code;
+	}
+	return a.offset < b.offset;
+}
+
+int MeterModbus::_offset(const struct addressparam *param) {
+	unsigned char highest_digit, power;
+
+	getHighestDigit(param->address, &highest_digit, &power);
+	int base = (int) pow((double) 10, (double) power);
+
+	switch (param->function_code) {
+			case READ_HOLDING_REGISTERS: return param->address - 4 * base - 1;
+			case READ_INPUT_REGISTERS:   return param->address - 3 * base - 1;
+			case READ_INPUT_STATUS:      return param->address - 2 * base - 1;
+			case READ_COIL_STATUS:       return param->address;
+			default:                     return -1;
 	}
-	_reset_connection = false;
-	return SUCCESS;
+}
+
+void MeterModbus::_prepare() {
+	size_t count = 0;
+
+	for (const struct addressparam *p = _addressparams; p->function_code != 0xFF; p++) {
+		count++;
+	}
+	_programs.resize(count);
+	_registers.clear();
+
+	for (const struct addressparam *p = _addressparams; p->function_code != 0xFF; p++) {
+		reg_t reg;
+		reg.param = p;
+		reg.program = &_programs[p - _addressparams];
+		reg.slave = (p->slave > 0) ? p->slave : _slave;
+		reg.offset = _offset(p);
+		reg.next = 0;
+		_type(p, reg);
+
+		/* the period is rounded to a multiple of the meters interval */
+		reg.period = 1;
+		if (p->period > 0 && _interval > 0) {
+			reg.period = std::max(1, (int) floor(p->period / _interval + 0.5));
+		}
+		else if (p->period > 0) {
+			print(log_warning, "Ignoring period of address %u, the meter has no interval", name().c_str(), p->address);
+		}
+
+		const char *error;
+		if (expression_compile(p->recalc_str, &_programs[p - _addressparams], &error) != 0) {
+			print(log_error, "Invalid expression \"%s\" for address %u: %s", name().c_str(), p->recalc_str, p->address, error);
+			throw vz::VZException("Invalid modbus expression");
+		}
+
+		if (reg.offset < 0) {
+			print(log_error, "Invalid address %u for function code %u", name().c_str(), p->address, p->function_code);
+			throw vz::VZException("Invalid modbus address");
+		}
+		_registers.push_back(reg);
+	}
+
+	std::stable_sort(_registers.begin(), _registers.end(), _compare);
+}
+
+void MeterModbus::_schedule() {
+	size_t due = 0;
+
+	for (std::vector<reg_t>::const_iterator it = _registers.begin(); it != _registers.end(); it++) {
+		if (it->next <= _tick) due++;
+	}
+
+	/* the blocks of the previous tick can be reused if everything is due again */
+	if (due == _registers.size() && _scheduled == due) {
+		return;
+	}
+
+	_blocks.clear();
+	for (std::vector<reg_t>::iterator it = _registers.begin(); it != _registers.end(); it++) {
+		if (it->next > _tick) continue;
+
+		int function_code = it->param->function_code;
+		int limit = (function_code == READ_COIL_STATUS || function_code == READ_INPUT_STATUS)
+			? MODBUS_MAX_READ_BITS : MODBUS_MAX_READ_REGISTERS;
+
+		if (_blocks.empty()
+				|| _blocks.back().slave != it->slave
+				|| _blocks.back().function_code != function_code
+				|| it->offset - (_blocks.back().start + _blocks.back().count) > _max_gap
+				|| it->offset + it->width - _blocks.back().start > limit) {
+			block_t block;
+			block.slave = it->slave;
+			block.function_code = function_code;
+			block.start = it->offset;
+			block.count = 0;
+			_blocks.push_back(block);
+		}
+
+		block_t &block = _blocks.back();
+		block.count = std::max(block.count, it->offset + it->width - block.start);
+		block.registers.push_back(&*it);
+	}
+
+	for (std::vector<block_t>::iterator it = _blocks.begin(); it != _blocks.end(); it++) {
+		it->regs.resize(it->count);
+		it->bits.resize(it->count);
+		print(log_debug, "Request slave %d, FC %u: offset %u, count %u (%u addresses)", name().c_str(),
+			it->slave, it->function_code, it->start, it->count, it->registers.size());
+	}
+
+	_scheduled = due;
+}
+
+int MeterModbus::open() {
+	struct timeval timeout;
+	timeout.tv_sec = _timeout / 1000;
+	timeout.tv_usec = (_timeout % 1000) * 1000;
+
+	/* the reading thread might be cancelled while still connecting */
+	int cancel_state;
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+
+	_connection->lock();
+	int rc = _connection->connect(timeout);
+	_connection->unlock();
+
+	pthread_setcancelstate(cancel_state, NULL);
+
+	return rc;
 }
 
 int MeterModbus::close() {
-	/*struct addressparam *addressptr = _addressparams;
-	while(addressptr->function_code != 0xFF){
-		print(log_debug, "Freeing Address %p", "", addressptr->recalc_str);
-		delete[] addressptr->recalc_str;
-		addressptr++;
+	/* the connection is closed once the last meter using it is gone */
+	return SUCCESS;
+}
+
+void MeterModbus::_type(const struct addressparam *param, reg_t &reg) {
+	static const struct {
+		const char *name;
+		type_t type;
+		int width;
+	} types[] = {
+		{ "uint16",  type_uint,  1 },
+		{ "int16",   type_int,   1 },
+		{ "uint32",  type_uint,  2 },
+		{ "int32",   type_int,   2 },
+		{ "float32", type_float, 2 },
+		{ "uint64",  type_uint,  4 },
+		{ "int64",   type_int,   4 },
+		{ "float64", type_float, 4 },
+		{ NULL,      type_uint,  0 }
+	};
+
+	reg.type = type_uint;
+	reg.width = 1;
+	reg.word_swap = false;
+	reg.byte_swap = false;
+
+	if (param->type == NULL) {
+		return;
+	}
+
+	std::string type(param->type), order;
+	size_t sep = type.find(':');
+	if (sep != std::string::npos) {
+		order = type.substr(sep + 1);
+		type.erase(sep);
+	}
+
+	int i;
+	for (i = 0; types[i].name && type != types[i].name; i++);
+	if (types[i].name == NULL) {
+		print(log_error, "Invalid type \"%s\" for address %u", name().c_str(), param->type, param->address);
+		throw vz::VZException("Invalid modbus register type");
+	}
+	reg.type = types[i].type;
+	reg.width = types[i].width;
+
+	/* byte order, "abcd" is the most significant byte first */
+	if (order == "" || order == "abcd") { }
+	else if (order == "cdab") { reg.word_swap = true; }
+	else if (order == "badc") { reg.byte_swap = true; }
+	else if (order == "dcba") { reg.word_swap = reg.byte_swap = true; }
+	else {
+		print(log_error, "Invalid byte order \"%s\" for address %u", name().c_str(), order.c_str(), param->address);
+		throw vz::VZException("Invalid modbus byte order");
+	}
+
+	if (reg.width > 1 && (param->function_code == READ_COIL_STATUS || param->function_code == READ_INPUT_STATUS)) {
+		print(log_error, "Coils and inputs can not have type %s (address %u)", name().c_str(), param->type, param->address);
+		throw vz::VZException("Invalid modbus register type");
 	}
-	free((void *)_addressparams);*/
-	modbus_close(_mb);
-	modbus_free(_mb);
-	return 0;
 }
 
-ssize_t MeterModbus::read(std::vector<Reading> &rds, size_t max_readings) {
-	uint16_t in;
+double MeterModbus::_decode(const reg_t &reg, const uint16_t *regs) {
+	uint64_t raw = 0;
+
+	for (int k = 0; k < reg.width; k++) {
+		uint16_t word = regs[reg.word_swap ? reg.width - 1 - k : k];
+		if (reg.byte_swap) {
+			word = (word << 8) | (word >> 8);
+		}
+		raw = (raw << 16) | word;
+	}
+
+	int bits = reg.width * 16;
+	switch (reg.type) {
+			case type_int:
+				if (bits < 64 && (raw & (1ULL << (bits - 1)))) {
+					raw |= ~0ULL << bits; /* sign extension */
+				}
+				return (double) (int64_t) raw;
+
+			case type_float:
+				if (bits == 32) {
+					uint32_t raw32 = (uint32_t) raw;
+					float f;
+					memcpy(&f, &raw32, sizeof(f));
+					return f;
+				}
+				else {
+					double d;
+					memcpy(&d, &raw, sizeof(d));
+					return d;
+				}
+
+			default:
+				return (double) raw;
+	}
+}
+
+bool MeterModbus::_store(const reg_t &reg, double in, Reading &rd) {
 	double out;
-	int rc;
-	const struct addressparam *current_address;
-	int read_count = 0;
-	
-	if(_reset_connection) {
-		int success;
-		print(log_info, "Resetting Connection to %s because of error", name().c_str(), _ip.c_str());
-		rc = open();
-		if(rc == SUCCESS)
-			_reset_connection = false;
-		else
+
+	print(log_debug, "Got %g via Modbus", "", in);
+	out = expression_evaluate(reg.program, in);
+	if(isnan(out)) {
+		print(log_error, "Unable to use value %g read from address %u. Error calculating: %s", name().c_str(), in, reg.param->address, reg.param->recalc_str);
+		return false;
+	}
+
+	rd.value(out);
+	rd.time();
+	rd.identifier(new AddressIdentifier(reg.param->address, (reg.param->slave > 0) ? reg.param->slave : 0));
+	return true;
+}
+
+void MeterModbus::_fail(int slave, const struct timeval &now) {
+	slave_t &state = _slaves[slave];
+	int delay = (state.failures < 16) ? (1 << state.failures) : _backoff;
+
+	state.failures++;
+	state.retry = now;
+	state.retry.tv_sec += (delay < _backoff) ? delay : _backoff;
+
+	print(log_warning, "Skipping slave %d for %d s after %d failed requests", name().c_str(),
+		slave, (int) (state.retry.tv_sec - now.tv_sec), state.failures);
+}
+
+void MeterModbus::_account(const std::vector<ModbusConnection::request_t> &requests) {
+	/* TCP frames carry a 7 byte MBAP header, RTU frames the slave id and a CRC */
+	size_t framing = (_device == "") ? 7 : 3;
+
+	for (std::vector<ModbusConnection::request_t>::const_iterator it = requests.begin(); it != requests.end(); it++) {
+		size_t pdu;
+		bool exception = (it->error > MODBUS_ENOBASE && it->error <= EMBXGTAR);
+
+		if (it->rc == -1 && !exception) {
+			/* no answer, the request might not even have been sent */
+			parsed(false);
+			_poll_stats.tx += framing + 5;
+			_poll_stats.requests++;
+			continue;
+		}
+		if (it->rc == -1) {
+			pdu = 2; /* exception response */
+		}
+		else if (it->function_code == READ_COIL_STATUS || it->function_code == READ_INPUT_STATUS) {
+			pdu = 2 + (it->count + 7) / 8;
+		}
+		else {
+			pdu = 2 + 2 * it->count;
+		}
+
+		received(framing + pdu);
+		parsed(it->rc != -1);
+		_poll_stats.tx += framing + 5;
+		_poll_stats.rx += framing + pdu;
+		_poll_stats.requests++;
+	}
+}
+
+void MeterModbus::_report() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	double elapsed = (now.tv_sec - _stats_time.tv_sec) + (now.tv_nsec - _stats_time.tv_nsec) / 1e9;
+	if (elapsed < _stats_interval || _poll_stats.polls == 0) return;
+
+	double polls = _poll_stats.polls;
+	print(log_info, "Statistics: %lu polls, %.1f requests/poll, %.0f/%.0f bytes/poll sent/received", name().c_str(),
+				_poll_stats.polls, _poll_stats.requests / polls, _poll_stats.tx / polls, _poll_stats.rx / polls);
+	print(log_info, "Statistics: poll latency %.1f ms avg, %.1f ms max, %.1f ms avg queued for %s", name().c_str(),
+				_poll_stats.latency * 1e3 / polls, _poll_stats.latency_max * 1e3, _poll_stats.wait * 1e3 / polls,
+				_connection->name().c_str());
+
+	memset(&_poll_stats, 0, sizeof(_poll_stats));
+	_stats_time = now;
+}
+
+ssize_t MeterModbus::read(std::vector<Reading> &rds, size_t max_readings) {
+	std::vector<ModbusConnection::request_t> requests, singles;
+	std::vector<block_t *> blocks;
+	size_t read_count = 0, planned = 0;
+	struct timeval now;
+	struct timespec start, locked, end;
+
+	vz::Clock::gettimeofday(&now);
+
+	/* only fetch the addresses which are due at this tick */
+	_schedule();
+	_tick++;
+
+	/* the blocks are sorted by slave, so each slave is polled back-to-back */
+	for (std::vector<block_t>::iterator block = _blocks.begin(); block != _blocks.end() && planned < max_readings; block++) {
+		slave_t &state = _slaves[block->slave];
+
+		if (state.failures > 0 && timercmp(&now, &state.retry, <)) {
+			continue; /* slave did not respond recently */
+		}
+
+		ModbusConnection::request_t req;
+		req.slave = block->slave;
+		req.function_code = block->function_code;
+		req.start = block->start;
+		req.count = block->count;
+		req.regs = &block->regs[0];
+		req.bits = &block->bits[0];
+		requests.push_back(req);
+		blocks.push_back(&*block);
+		planned += block->registers.size();
+	}
+
+	struct timeval timeout;
+	timeout.tv_sec = _timeout / 1000;
+	timeout.tv_usec = (_timeout % 1000) * 1000;
+
+	/* a cancelled poll would block the connection for all other meters */
+	int cancel_state;
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	_connection->lock();
+	clock_gettime(CLOCK_MONOTONIC, &locked);
+	if (!_connection->connected()) {
+		print(log_info, "Resetting Connection to %s because of error", name().c_str(), _connection->name().c_str());
+		if (_connection->connect(timeout) != SUCCESS) {
+			_connection->unlock();
+			pthread_setcancelstate(cancel_state, NULL);
 			return 0;
+		}
 	}
-	current_address = _addressparams;
-	unsigned char highest_digit, power;
-	while((current_address->function_code != 0xFF) && (max_readings > read_count)) {
-		getHighestDigit(current_address->address, &highest_digit, &power);
-		switch(current_address->function_code){
-			case READ_HOLDING_REGISTERS:
-				print(log_debug, "Accessing Holding Register %u", name().c_str(), current_address->address);
-				rc = modbus_read_registers(_mb, current_address->address-4*(unsigned int)pow((double)10,(double)power)-1, 1, &in);
-				break;
-			case READ_INPUT_REGISTERS:
-				print(log_debug, "Accessing Input Register %u", name().c_str(), current_address->address);
-				rc = modbus_read_input_registers(_mb, current_address->address-3*(unsigned int)pow((double)10,(double)power)-1, 1, &in);
-				break;
-			case READ_COIL_STATUS:
-				print(log_debug, "Accessing Coil Status register %u", name().c_str(), current_address->address);
-				rc = modbus_read_bits(_mb, current_address->address, 1, (uint8_t *)&in);
-				break;
-			case READ_INPUT_STATUS:
-				print(log_debug, "Accessing Input Status register %u", name().c_str(), current_address->address);
-				rc = modbus_read_input_bits(_mb, current_address->address-2*(unsigned int)pow((double)10,(double)power)-1, 1, (uint8_t *)&in);
-				break;
-		}
-		
-		if (rc == -1 && errno != 112345680) { //Except Illegal Data Address
-			print(log_error, "Unable to fetch data (FC: %u, ADR: %u): %s", name().c_str(), current_address->function_code, current_address->address, modbus_strerror(errno));
-			if(errno == 104 || errno == 32){
-				close();
-				_reset_connection = true;
+
+	_connection->transfer(requests, _pipeline);
+
+	/* blocks spanning an illegal address: fall back to single requests */
+	for (size_t k = 0; k < requests.size(); k++) {
+		if (requests[k].rc == -1 && requests[k].error == EMBXILADD && blocks[k]->registers.size() > 1) {
+			for (std::vector<reg_t *>::const_iterator reg = blocks[k]->registers.begin(); reg != blocks[k]->registers.end(); reg++) {
+				ModbusConnection::request_t req = requests[k];
+				req.start = (*reg)->offset;
+				req.count = (*reg)->width;
+				req.regs += (*reg)->offset - blocks[k]->start;
+				req.bits += (*reg)->offset - blocks[k]->start;
+				singles.push_back(req);
 			}
-			return read_count;
 		}
-		
-		if(rc == -1 && errno == 112345680){
-			print(log_error, "Unable to fetch data (FC: %u, ADR: %u): %s", name().c_str(), current_address->function_code, current_address->address, modbus_strerror(errno));
-			current_address++;
-			continue;
+	}
+	if (!singles.empty()) {
+		if (_connection->connected()) {
+			_connection->transfer(singles, _pipeline);
 		}
-		
-		print(log_debug, "Got %u via Modbus", "", in);
-		// TODO ERRORS possible if wrong format string input from config file
-		char *math_expression;
-		asprintf(&math_expression, current_address->recalc_str, in);
-		print(log_debug, "Calulating: %s --> %s", "", current_address->recalc_str, math_expression);
-		out = parse_expression(math_expression);
-		if(isnan(out)) {
-			print(log_error, "Unable to use value read from address %u. Error calculating: %s", name().c_str(), current_address->address, math_expression);
+		else { /* lost while transferring the blocks */
+			for (std::vector<ModbusConnection::request_t>::iterator req = singles.begin(); req != singles.end(); req++) {
+				req->rc = -1;
+				req->error = ECONNRESET;
+			}
 		}
-		else {
-			rds[read_count].value(out);
-			rds[read_count].time();
-			rds[read_count].identifier(new AddressIdentifier(current_address->address));
-			read_count++;
+	}
+	_connection->unlock();
+	pthread_setcancelstate(cancel_state, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	_account(requests);
+	_account(singles);
+
+	double wait = (locked.tv_sec - start.tv_sec) + (locked.tv_nsec - start.tv_nsec) / 1e9;
+	double latency = (end.tv_sec - locked.tv_sec) + (end.tv_nsec - locked.tv_nsec) / 1e9;
+	_poll_stats.polls++;
+	_poll_stats.latency += latency;
+	_poll_stats.latency_max = std::max(_poll_stats.latency_max, latency);
+	_poll_stats.wait += wait;
+
+	print(log_debug, "Poll took %.1f ms for %u requests (%.1f ms queued)", name().c_str(),
+		latency * 1e3, requests.size() + singles.size(), wait * 1e3);
+	if (_stats_interval > 0) {
+		_report();
+	}
+
+	std::vector<ModbusConnection::request_t>::const_iterator single = singles.begin();
+	for (size_t k = 0; k < requests.size(); k++) {
+		const block_t *block = blocks[k];
+		const ModbusConnection::request_t &req = requests[k];
+		slave_t &state = _slaves[block->slave];
+
+		if (req.rc == -1 && state.failures > 0 && timercmp(&now, &state.retry, <)) {
+			if (req.error == EMBXILADD && block->registers.size() > 1) {
+				single += block->registers.size(); /* skip the unused fallback requests */
+			}
+			continue; /* slave already failed during this poll */
+		}
+
+		if (req.rc == -1 && (req.error != EMBXILADD || block->registers.size() == 1)) {
+			print(log_error, "Unable to fetch data (FC: %u, ADR: %u): %s", name().c_str(), block->function_code, block->registers.front()->param->address, modbus_strerror(req.error));
+			if (req.error != EMBXILADD && req.error != ECONNRESET && req.error != EPIPE) {
+				_fail(block->slave, now);
+			}
+			continue;
+		}
+		state.failures = 0;
+
+		for (std::vector<reg_t *>::const_iterator reg = block->registers.begin(); reg != block->registers.end(); reg++) {
+			int i = (*reg)->offset - block->start;
+
+			/* the slave answered, the address is due again after its period */
+			(*reg)->next = _tick - 1 + (*reg)->period;
+
+			if (req.rc == -1) {
+				const ModbusConnection::request_t &fallback = *single++;
+				if (fallback.rc == -1) {
+					print(log_error, "Unable to fetch data (FC: %u, ADR: %u): %s", name().c_str(), block->function_code, (*reg)->param->address, modbus_strerror(fallback.error));
+					continue;
+				}
+			}
+
+			if (read_count < max_readings) {
+				double in = (block->function_code == READ_COIL_STATUS || block->function_code == READ_INPUT_STATUS)
+					? block->bits[i] : _decode(**reg, &block->regs[i]);
+				if (_store(**reg, in, rds[read_count])) {
+					read_count++;
+				}
+			}
 		}
-		free(math_expression);
-		current_address++;
 	}
-	
+
 	return read_count;
 }
-
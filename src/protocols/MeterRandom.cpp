@@ -27,8 +27,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <time.h>
+#include <unistd.h>
 #include <sys/time.h>
 
 #include "protocols/MeterRandom.hpp"
@@ -37,39 +39,103 @@
 
 MeterRandom::MeterRandom(std::list<Option> options)
 		: Protocol("random")
+		, _current(0)
+		, _start(0)
+		, _emitted(0)
 {
 	OptionList optlist;
+	int identifiers;
 
-	_min = 0;
-	_max = 40;
-	_last = (_max + _min) / 2; /* start in the middle */
+	try {
+		_min = optlist.lookup_double(options, "min", 0);
+	} catch( vz::VZException &e ) {
+		print(log_error, "Min value has to be a floating point number (e.g. '40.0')", name().c_str());
+		throw;
+	}
+
+	try {
+		_max = optlist.lookup_double(options, "max", 40);
+	} catch( vz::VZException &e ) {
+		print(log_error, "Max value has to be a floating point number (e.g. '40.0')", name().c_str());
+		throw;
+	}
+	if (_max < _min) throw vz::VZException("Max value has to be greater than min value.");
 
 	try {
-		_min = optlist.lookup_double(options, "min");
+		const char *model = optlist.lookup_string(options, "model");
+
+		if (strcmp(model, "walk") == 0) _model = model_walk;
+		else if (strcmp(model, "counter") == 0) _model = model_counter;
+		else if (strcmp(model, "step") == 0) _model = model_step;
+		else {
+			print(log_error, "Unknown model: %s", name().c_str(), model);
+			throw vz::VZException("Unknown model.");
+		}
 	} catch( vz::OptionNotFoundException &e ) {
-		_min = 0;
+		_model = model_walk;
 	} catch( vz::VZException &e ) {
-		print(log_error, "Min value has to be a floating point number (e.g. '40.0')", name().c_str());
+		print(log_error, "Model has to be one of walk, counter or step", name().c_str());
+		throw;
+	}
+
+	try {
+		_period = optlist.lookup_int(options, "period", 10);
+	} catch( vz::VZException &e ) {
+		print(log_error, "Failed to parse period", name().c_str());
+		throw;
+	}
+	if (_period < 1) throw vz::VZException("Period must be greater than 0.");
+
+	try {
+		identifiers = optlist.lookup_int(options, "identifiers", 1);
+	} catch( vz::VZException &e ) {
+		print(log_error, "Failed to parse identifiers", name().c_str());
+		throw;
+	}
+	if (identifiers < 1) throw vz::VZException("Number of identifiers must be greater than 0.");
+
+	try {
+		_rate = optlist.lookup_double(options, "rate", 0);
+	} catch( vz::VZException &e ) {
+		print(log_error, "Failed to parse rate", name().c_str());
 		throw;
 	}
+	if (_rate < 0) throw vz::VZException("Rate must not be negative.");
 
 	try {
-		_max = optlist.lookup_double(options, "max");
+		_seed = optlist.lookup_int(options, "seed");
 	} catch( vz::OptionNotFoundException &e ) {
-		_max = 0;
+		_seed = time(NULL) ^ ((uint64_t) getpid() << 32);
 	} catch( vz::VZException &e ) {
-		print(log_error, "Max value has to be a floating point number (e.g. '40.0')", name().c_str());
+		print(log_error, "Failed to parse seed", name().c_str());
 		throw;
 	}
+
+	/* a single identifier keeps the name of former versions */
+	for (int i = 0; i < identifiers; i++) {
+		char id[16];
+		snprintf(id, sizeof(id), (identifiers == 1) ? "test" : "test%d", i);
+		_ids.push_back(ReadingIdentifier::Ptr(new StringIdentifier(id)));
+	}
 }
 
 MeterRandom::~MeterRandom() {
 }
 
 int MeterRandom::open() {
+	struct timeval tv;
+
+	/* restart the series, a fixed seed reproduces it */
+	_state = _seed * 0x9E3779B97F4A7C15ULL + 1;
+	if (_state == 0) _state = 1;
+
+	_values.assign(_ids.size(), (_model == model_counter) ? 0 : (_max + _min) / 2); /* start in the middle */
+	_steps.assign(_ids.size(), 0);
+	_current = 0;
+	_emitted = 0;
 
-	// TODO rewrite to use /dev/u?random
-	srand(time(NULL)); /* initialize PNRG */
+	vz::Clock::gettimeofday(&tv);
+	_start = tv.tv_sec + tv.tv_usec / 1e6;
 
 	return SUCCESS; /* can't fail */
 }
@@ -79,18 +145,87 @@ int MeterRandom::close() {
 	return SUCCESS;
 }
 
-ssize_t MeterRandom::read(std::vector<Reading> &rds, size_t n) {
-	if(rds.size() < 1) return -1;
+double MeterRandom::_uniform() {
+	_state ^= _state >> 12;
+	_state ^= _state << 25;
+	_state ^= _state >> 27;
+
+	return (((_state * 2685821657736338717ULL) >> 11) + 0.5) / 9007199254740992.0;
+}
 
-	double step = ltqnorm((float) rand() / RAND_MAX);
-	double newval = _last + step;
+double MeterRandom::_next(size_t id) {
+	double &value = _values[id];
 
-	/* check boundaries */
-	_last += (newval > _max || newval < _min) ? -step : step;
+	switch (_model) {
+		case model_walk: {
+			double step = ltqnorm(_uniform());
+			double newval = value + step;
 
-	rds[0].value(_last);
-	rds[0].time();
-	rds[0].identifier(new StringIdentifier("test"));
+			/* check boundaries */
+			value += (newval > _max || newval < _min) ? -step : step;
+			break;
+		}
+
+		case model_counter:
+			value += 1;
+			break;
+
+		case model_step:
+			value = ((_steps[id] / _period) % 2) ? _max : _min;
+			break;
+	}
+
+	_steps[id]++;
+	return value;
+}
+
+ssize_t MeterRandom::read(std::vector<Reading> &rds, size_t n) {
+	size_t count;
+	struct timeval tv;
+
+	if (n < 1) return -1;
+
+	vz::Clock::gettimeofday(&tv);
+
+	if (_rate > 0) {
+		/* emit everything which has become due since the last call */
+		double now = tv.tv_sec + tv.tv_usec / 1e6;
+		double due = floor((now - _start) * _rate) - _emitted;
+
+		if (due < 1) {
+			vz::Clock::sleep(_start + (_emitted + 1) / _rate - now);
+			due = 1;
+		}
+		else if (due > n) {
+			/* the consumer can't keep up: drop the backlog instead of lagging behind forever */
+			print(log_warning, "Dropping %.0f readings which could not be delivered in time", name().c_str(), due - n);
+			_emitted += (unsigned long long) due - n;
+			due = n;
+		}
+
+		count = (due < n) ? (size_t) due : n;
+	}
+	else {
+		/* one reading per identifier */
+		count = (_ids.size() < n) ? _ids.size() : n;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		rds[i].identifier(_ids[_current]);
+		rds[i].value(_next(_current));
+
+		if (_rate > 0) {
+			/* readings are spaced exactly by the rate */
+			struct timeval ts = rds[i].dtotv(_start + (_emitted + 1) / _rate);
+			rds[i].time(ts);
+		}
+		else {
+			rds[i].time(tv);
+		}
+
+		_current = (_current + 1) % _ids.size();
+		_emitted++;
+	}
 
-	return 1;
+	return count;
 }
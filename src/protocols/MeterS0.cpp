@@ -28,52 +28,158 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#include <time.h>
+#include <poll.h>
 #include <errno.h>
 
+#include <algorithm>
+
 #include "protocols/MeterS0.hpp"
 #include "Options.hpp"
 #include <VZException.hpp>
 
+/* characters can't be received faster than one per frame: start + 8 data + stop bit at 300 baud */
+static const double char_time = 10.0 / 300;
+
+static void unlock_mutex(void *mutex) {
+	pthread_mutex_unlock((pthread_mutex_t *) mutex);
+}
+
+static double monotonic() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double realtime() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static struct timeval to_timeval(double t) {
+	struct timeval tv;
+	tv.tv_sec = (time_t) t;
+	tv.tv_usec = (suseconds_t) ((t - tv.tv_sec) * 1e6);
+	return tv;
+}
+
 MeterS0::MeterS0(std::list<Option> options)
 		: Protocol("s0")
-		, _counter(0)
+		, _running(false)
 {
 	OptionList optlist;
+	const struct inputparam *inputs = NULL;
+	const char *device = NULL;
+	int resolution;
+	double debounce;
 
 	try {
-		_device = optlist.lookup_string(options, "device");
+		inputs = optlist.lookup_inputparams(options, "inputs");
+	} catch( vz::OptionNotFoundException &e ) {
+		try {
+			device = optlist.lookup_string(options, "device");
+		} catch( vz::VZException &e ) {
+			print(log_error, "Missing device or invalid type", "");
+			throw;
+		}
 	} catch( vz::VZException &e ) {
-		print(log_error, "Missing device or invalid type", "");
+		print(log_error, "Failed to parse inputs", "");
 		throw;
 	}
 
+	/* defaults for all inputs */
 	try {
-		_resolution = optlist.lookup_int(options, "resolution");
-	} catch( vz::OptionNotFoundException &e ) {
-		_resolution = 1000;
+		resolution = optlist.lookup_int(options, "resolution", 1000);
 	} catch( vz::VZException &e ) {
 		print(log_error, "Failed to parse resolution", "");
 		throw;
 	}
-	if(_resolution < 1) throw vz::VZException("Resolution must be greater than 0.");
+
+	try {
+		debounce = optlist.lookup_int(options, "debounce") / 1000.0;
+	} catch( vz::OptionNotFoundException &e ) {
+		debounce = 0.03;
+	} catch( vz::VZException &e ) {
+		print(log_error, "Failed to parse debounce", "");
+		throw;
+	}
+
+	try {
+		_window = optlist.lookup_int(options, "window", 60);
+	} catch( vz::VZException &e ) {
+		print(log_error, "Failed to parse window", "");
+		throw;
+	}
+
+	try {
+		_interval = optlist.lookup_double(options, "interval");
+	} catch( vz::VZException &e ) {
+		_interval = 0;
+	}
+
+	input_t input;
+	input.resolution = resolution;
+	input.debounce = debounce;
+	input.fd = -1;
+	input.counter = input.reported = 0; /* kept when the meter is reopened */
+	input.last_real = 0;
+	input.head = 0;
+
+	if (inputs == NULL) {
+		input.device = device;
+		_inputs.push_back(input);
+	}
+	else {
+		for (const struct inputparam *p = inputs; p->device != NULL; p++) {
+			input.device = p->device;
+			input.name = p->name;
+			input.resolution = (p->resolution >= 0) ? p->resolution : resolution;
+			input.debounce = (p->debounce >= 0) ? p->debounce / 1000.0 : debounce;
+			_inputs.push_back(input);
+		}
+		if (_inputs.empty()) throw vz::VZException("No inputs configured.");
+		if (_inputs.size() > S0_MAX_INPUTS) throw vz::VZException("Too many inputs.");
+	}
+
+	for (std::vector<input_t>::const_iterator it = _inputs.begin(); it != _inputs.end(); it++) {
+		if (it->resolution < 1) throw vz::VZException("Resolution must be greater than 0.");
+		if (it->debounce < 0) throw vz::VZException("Debounce must not be negative.");
+	}
+
+	_wakeup[0] = _wakeup[1] = -1;
+
+	pthread_mutex_init(&_mutex, NULL);
+	pthread_cond_init(&_cond, NULL);
 }
 
 MeterS0::~MeterS0() {
-	//free((void*)_device);
+	pthread_cond_destroy(&_cond);
+	pthread_mutex_destroy(&_mutex);
 }
 
-int MeterS0::open() {
+int MeterS0::_open_device(input_t &input) {
 
 	/* open port */
-	int fd = ::open(_device, O_RDWR | O_NOCTTY); 
+	int fd = ::open(input.device.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
 
 	if (fd < 0) {
-		print(log_error, "open(%s): %s", "", _device, strerror(errno));
+		print(log_error, "open(%s): %s", name().c_str(), input.device.c_str(), strerror(errno));
 		return ERR;
 	}
 
+	input.fd = fd;
+	input.wakeup = 0;
+	input.active = true;
+
+	input.tty = isatty(fd);
+	if (!input.tty) {
+		print(log_debug, "%s is not a tty, skipping serial configuration", name().c_str(), input.device.c_str());
+		return SUCCESS;
+	}
+
 	/* save current port settings */
-	tcgetattr(fd, &_old_tio);
+	tcgetattr(fd, &input.old_tio);
 
 	/* configure port */
 	struct termios tio;
@@ -90,55 +196,267 @@ int MeterS0::open() {
 
 	/* apply configuration */
 	tcsetattr(fd, TCSANOW, &tio);
-	_fd = fd;
+
+	return SUCCESS;
+}
+
+void MeterS0::_close_device(input_t &input) {
+	if (input.fd < 0) return;
+
+	if (input.tty) {
+		tcsetattr(input.fd, TCSANOW, &input.old_tio); /* reset serial port */
+	}
+	::close(input.fd); /* close serial port */
+	input.fd = -1;
+}
+
+int MeterS0::open() {
+
+	for (std::vector<input_t>::iterator it = _inputs.begin(); it != _inputs.end(); it++) {
+		if (_open_device(*it) != SUCCESS) {
+			for (std::vector<input_t>::iterator jt = _inputs.begin(); jt != it; jt++) {
+				_close_device(*jt);
+			}
+			return ERR;
+		}
+	}
+
+	if (pipe(_wakeup) < 0) {
+		print(log_error, "pipe(): %s", name().c_str(), strerror(errno));
+		for (std::vector<input_t>::iterator it = _inputs.begin(); it != _inputs.end(); it++) {
+			_close_device(*it);
+		}
+		return ERR;
+	}
+
+	/* a single engine thread serves all inputs */
+	_running = true;
+	int ret = pthread_create(&_thread, NULL, &_engine, (void *) this);
+	if (ret != 0) {
+		print(log_error, "Cannot start pulse engine: %s", name().c_str(), strerror(ret));
+		_running = false;
+		::close(_wakeup[0]);
+		::close(_wakeup[1]);
+		for (std::vector<input_t>::iterator it = _inputs.begin(); it != _inputs.end(); it++) {
+			_close_device(*it);
+		}
+		return ERR;
+	}
 
 	return SUCCESS;
 }
 
 int MeterS0::close() {
 
-	tcsetattr(_fd, TCSANOW, &_old_tio); /* reset serial port */
+	/* stop the engine */
+	if (::write(_wakeup[1], "", 1) != 1) {
+		print(log_error, "Cannot stop pulse engine: %s", name().c_str(), strerror(errno));
+	}
+	pthread_join(_thread, NULL);
+	::close(_wakeup[0]);
+	::close(_wakeup[1]);
 
-	return ::close(_fd); /* close serial port */
+	for (std::vector<input_t>::iterator it = _inputs.begin(); it != _inputs.end(); it++) {
+		_close_device(*it);
+	}
+
+	return SUCCESS;
 }
 
-ssize_t MeterS0::read(std::vector<Reading> &rds, size_t n) {
+void *MeterS0::_engine(void *arg) {
+	static_cast<MeterS0 *>(arg)->_run();
+	return NULL;
+}
+
+void MeterS0::_run() {
+	struct pollfd fds[S0_MAX_INPUTS + 1];
+	size_t n = _inputs.size();
+	size_t active = n;
+
+	for (size_t i = 0; i < n; i++) {
+		fds[i].fd = _inputs[i].fd;
+		fds[i].events = POLLIN;
+	}
+	fds[n].fd = _wakeup[0];
+	fds[n].events = POLLIN;
+
+	while (active > 0) {
+		if (poll(fds, n + 1, -1) < 0) {
+			if (errno == EINTR) continue;
+			print(log_error, "poll(): %s", name().c_str(), strerror(errno));
+			break;
+		}
+
+		/* timestamp as close to the wakeup as possible */
+		double mono = monotonic();
+		double real = realtime();
+
+		if (fds[n].revents) break; /* close() */
+
+		pthread_mutex_lock(&_mutex);
+		for (size_t i = 0; i < n; i++) {
+			if (fds[i].revents == 0) continue;
+
+			if (!_receive(_inputs[i], mono, real)) {
+				fds[i].fd = -1; /* ignored by poll() */
+				_inputs[i].active = false;
+				active--;
+			}
+		}
+		pthread_cond_broadcast(&_cond);
+		pthread_mutex_unlock(&_mutex);
+	}
+
+	pthread_mutex_lock(&_mutex);
+	_running = false;
+	pthread_cond_broadcast(&_cond);
+	pthread_mutex_unlock(&_mutex);
+}
+
+bool MeterS0::_receive(input_t &input, double mono, double real) {
+	char buf[64];
+
+	ssize_t bytes = ::read(input.fd, buf, sizeof(buf));
+	if (bytes < 0) {
+		if (errno == EINTR || errno == EAGAIN) return true;
+		print(log_error, "read(%s): %s", name().c_str(), input.device.c_str(), strerror(errno));
+		return false;
+	}
+	else if (bytes == 0) {
+		print(log_error, "Device %s disconnected", name().c_str(), input.device.c_str());
+		return false;
+	}
+
+	/* each character is a pulse; characters which were delivered together
+	 * have been received back to back, one frame apart, but after our last wakeup */
+	double spacing = std::min(char_time, (mono - input.wakeup) / bytes);
+	for (ssize_t i = 0; i < bytes; i++) {
+		double offset = (bytes - 1 - i) * spacing;
+		_pulse(input, mono - offset, real - offset);
+	}
+	input.wakeup = mono;
+
+	return true;
+}
 
-	struct timeval time1;
-	struct timeval time2;
-	char buf[8];
+void MeterS0::_pulse(input_t &input, double mono, double real) {
+	/* software debounce: drop pulses following the last one too closely */
+	if (input.counter > 0 && mono - input.pulses[(input.head + S0_WINDOW_LEN - 1) % S0_WINDOW_LEN] < input.debounce) {
+		return;
+	}
 
-	/* clear input buffer */
-	tcflush(_fd, TCIOFLUSH);
+	input.pulses[input.head] = mono;
+	input.head = (input.head + 1) % S0_WINDOW_LEN;
+	input.last_real = real;
+	input.counter++;
+}
 
-	/* blocking until one character/pulse is read */
-	if( ::read(_fd, buf, 8) < 1) return 0;
-	gettimeofday(&time1, NULL);
-	if( ::read(_fd, buf, 8) < 1) return 0;
-	gettimeofday(&time2, NULL);
+double MeterS0::_power(const input_t &input, double now) const {
+	size_t avail = (input.counter < S0_WINDOW_LEN) ? input.counter : S0_WINDOW_LEN;
+	if (avail < 2) return -1;
 
-	double t1 = time1.tv_sec + time1.tv_usec / 1e6;
-	double t2 = time2.tv_sec + time2.tv_usec / 1e6;
-	double value = ( 3600000 ) / ( (t2-t1) * _resolution ) ;
-	
-	/* store current timestamp */
-	ReadingIdentifier *rid(new NilIdentifier());
-	rds[0].identifier(new StringIdentifier("Counter"));
-	rds[0].time(time2);
-	rds[0].value(++_counter);
+	double newest = input.pulses[(input.head + S0_WINDOW_LEN - 1) % S0_WINDOW_LEN];
+	double oldest = newest;
+	size_t k = 1;
 
-	rds[1].identifier(rid);
-	rds[1].time(time2);
-	rds[1].value(1);
+	/* go back in time until the window is full, but use at least the last two pulses */
+	while (k < avail) {
+		double t = input.pulses[(input.head + S0_WINDOW_LEN - 1 - k) % S0_WINDOW_LEN];
+		if (k > 1 && newest - t > _window) break;
+		oldest = t;
+		k++;
+	}
+	if (newest <= oldest) return -1;
 
-	rds[2].identifier(new StringIdentifier("Power"));
-	rds[2].time(time2);
-	rds[2].value(value);
+	double power = 3600000 * (k - 1) / (input.resolution * (newest - oldest));
 
-	print(log_debug, "Reading S0 - n=%d power=%f  counter=%f", name().c_str(), n, value, rds[2].value());
-	/* wait some ms for debouncing */
-	usleep(30000);
+	/* the pulse currently in progress takes at least as long as we are already waiting for it */
+	double idle = now - newest;
+	if (idle > 0 && 3600000 / (input.resolution * idle) < power) {
+		power = 3600000 / (input.resolution * idle);
+	}
 
-	return 1;
+	return power;
+}
+
+bool MeterS0::_pending() const {
+	for (std::vector<input_t>::const_iterator it = _inputs.begin(); it != _inputs.end(); it++) {
+		if (it->counter != it->reported) return true;
+	}
+	return false;
 }
 
+ssize_t MeterS0::read(std::vector<Reading> &rds, size_t n) {
+	size_t i = 0;
+	bool pending, running;
+
+	/* a quiet meter is not stalled, report the unchanged counters at the deadline */
+	struct timespec until;
+	clock_gettime(CLOCK_REALTIME, &until);
+	until.tv_sec += deadline() / 1000;
+	until.tv_nsec += (deadline() % 1000) * 1000000;
+	if (until.tv_nsec >= 1000000000) {
+		until.tv_sec++;
+		until.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&_mutex);
+	pthread_cleanup_push(unlock_mutex, &_mutex);
+
+	/* without an interval we report new pulses as they arrive */
+	while (_interval <= 0 && _running && !_pending()) {
+		if (deadline() < 0) {
+			pthread_cond_wait(&_cond, &_mutex);
+		}
+		else if (pthread_cond_timedwait(&_cond, &_mutex, &until) == ETIMEDOUT) {
+			break;
+		}
+	}
+
+	double now = monotonic();
+	double real = realtime();
+	struct timeval tv_now = to_timeval(real);
+
+	pending = _pending();
+	running = _running;
+
+	for (std::vector<input_t>::iterator it = _inputs.begin(); it != _inputs.end() && i + 3 <= n; it++) {
+		unsigned long long delta = it->counter - it->reported;
+		double power = _power(*it, now);
+		struct timeval tv_last = to_timeval((it->counter > 0) ? it->last_real : real);
+
+		it->reported = it->counter;
+
+		/* with a single input the identifiers stay compatible to former versions */
+		rds[i].identifier(new StringIdentifier(it->name.empty() ? "Counter" : it->name + "/Counter"));
+		rds[i].time(tv_last);
+		rds[i].value(it->counter);
+		i++;
+
+		/* pulses since the last reading */
+		rds[i].identifier(new StringIdentifier(it->name.empty() ? "Pulses" : it->name + "/Pulses"));
+		rds[i].time(tv_last);
+		rds[i].value(delta);
+		i++;
+
+		if (power >= 0) {
+			rds[i].identifier(new StringIdentifier(it->name.empty() ? "Power" : it->name + "/Power"));
+			rds[i].time(tv_now);
+			rds[i].value(power);
+			i++;
+		}
+
+		print(log_debug, "Reading S0 %s - counter=%llu delta=%llu power=%f", name().c_str(),
+					it->device.c_str(), it->counter, delta, power);
+	}
+
+	pthread_cleanup_pop(1);
+
+	if (!running && !pending) {
+		print(log_error, "Pulse engine stopped", name().c_str());
+		lost(0); /* all inputs are gone */
+		return 0;
+	}
+
+	return i;
+}
@@ -32,7 +32,6 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
-#include <math.h>
 #include <sys/time.h>
 
 /* serial port */
@@ -44,7 +43,6 @@
 #include <sys/socket.h>
 
 /* sml stuff */
-#include <sml/sml_file.h>
 #include <sml/sml_transport.h>
 
 #include "protocols/MeterSML.hpp"
@@ -77,6 +75,8 @@ MeterSML::MeterSML(std::list<Option> options)
 		throw;
 	}
 
+	_timeout = optlist.lookup_int(options, "timeout", PROTOCOL_CONNECT_TIMEOUT);
+
 	/* baudrate */
 	int baudrate = 9600; /* default to avoid compiler warning */
 	try {
@@ -121,19 +121,19 @@ int MeterSML::open() {
 		_fd = _openDevice(&_old_tio, _baudrate);
 	}
 	else if (_host != "") {
-		char *addr = strdup(host());
+		char *copy = strdup(host()), *addr = copy;
 		const char *node = strsep(&addr, ":");
 		const char *service = strsep(&addr, ":");
-		if(node == NULL && service == NULL) return -1;
-		_fd = _openSocket(node, service);
-		free(addr);
+		if(node == NULL && service == NULL) { free(copy); return -1; }
+		_fd = connect(node, service, _timeout);
+		free(copy);
 	}
 	return _fd;
 }
 
 int MeterSML::close() {
 
-	if (_device != "") {
+	if (_device != "" && _tty) {
 		/* reset serial port */
 		tcsetattr(_fd, TCSANOW, &_old_tio);
 	}
@@ -144,99 +144,28 @@ int MeterSML::close() {
 ssize_t MeterSML::read(std::vector<Reading> &rds, size_t n) {
 
 	unsigned char buffer[SML_BUFFER_LEN];
-	size_t bytes, m = 0;
+	size_t bytes;
 
-	sml_file *file;
-	sml_get_list_response *body;
-	sml_list *entry;
+	/* libsml does not report a closed connection, check before it blocks */
+	if (!readable(_fd)) {
+		return 0;
+	}
 
 	/* wait until a we receive a new datagram from the meter (blocking read) */
 	bytes = sml_transport_read(_fd, buffer, SML_BUFFER_LEN);
+	received(bytes);
 
 	if(bytes < 16 ) {
 		print(log_error, "short message from sml_transport_read len=%d", name().c_str(), bytes);
+		parsed(false);
 		return(0);
 	}
 
-	/* parse SML file & stripping escape sequences */
-	file = sml_file_parse(buffer + 8, bytes - 16);
-
-	/* obtain SML messagebody of type getResponseList */
-	for (short i = 0; i < file->messages_len; i++) {
-		sml_message *message = file->messages[i];
-
-		if (*message->message_body->tag == SML_MESSAGE_GET_LIST_RESPONSE) {
-			body = (sml_get_list_response *) message->message_body->data;
-			entry = body->val_list;
-
-			/* iterating through linked list */
-			for (m = 0; m < n && entry != NULL; m++) {
-				_parse(entry, &rds[m]);
-				entry = entry->next;
-			}
-		}
-	}
-
-	/* free the malloc'd memory */
-	sml_file_free(file);
-
-	return m+1;
-}
-
-void MeterSML::_parse(sml_list *entry, Reading *rd) {
-	//int unit = (entry->unit) ? *entry->unit : 0;
-	int scaler = (entry->scaler) ? *entry->scaler : 1;
-	
-	rd->value(sml_value_to_double(entry->value) * pow(10, scaler));
-
-	Obis obis((unsigned char)entry->obj_name->str[0],
-						(unsigned char)entry->obj_name->str[1],
-						(unsigned char)entry->obj_name->str[2],
-						(unsigned char)entry->obj_name->str[3],
-						(unsigned char)entry->obj_name->str[4],
-						(unsigned char)entry->obj_name->str[5]);
-	ReadingIdentifier *rid(new ObisIdentifier(obis));
-	rd->identifier(rid);
-	
-	// TODO handle SML_TIME_SEC_INDEX or time by SML File/Message
-	struct timeval tv;
-	if (entry->val_time) { /* use time from meter */
-		tv.tv_sec = *entry->val_time->data.timestamp;
-		tv.tv_usec = 0;
-	}
-	else {
-		gettimeofday(&tv, NULL); /* use local time */
-	}
-	rd->time(tv);
-}
-
-int MeterSML::_openSocket(const char *node, const char *service) {
-	struct sockaddr_in sin;
-	struct addrinfo *ais;
-	int fd, res;
-
-	fd = socket(PF_INET, SOCK_STREAM, 0);
-	if (fd < 0) {
-		print(log_error, "socket(): %s", name().c_str(), strerror(errno));
-		return ERR;
-	}
-
-	int rc = getaddrinfo(node, service, NULL, &ais);
-	if (rc != 0) {
-		print(log_error, "getaddrinfo(%s, %s): %s", name().c_str(), node, service, gai_strerror(rc));
-		return ERR;
-	}
-
-	memcpy(&sin, ais->ai_addr, ais->ai_addrlen);
-	freeaddrinfo(ais);
-
-	res = connect(fd, (struct sockaddr *) &sin, sizeof(sin));
-	if (res < 0) {
-		print(log_error, "connect(%s, %s): %s", name().c_str(), node, service, strerror(errno));
-		return ERR;
-	}
+	/* decode SML file & stripping escape sequences */
+	size_t i = _decoder.decode(buffer + 8, bytes - 16, rds, n);
+	parsed();
 
-	return fd;
+	return i;
 }
 
 int MeterSML::_openDevice(struct termios *old_tio, speed_t baudrate) {
@@ -250,6 +179,12 @@ int MeterSML::_openDevice(struct termios *old_tio, speed_t baudrate) {
 		return ERR;
 	}
 
+	_tty = isatty(fd);
+	if (!_tty) {
+		print(log_debug, "%s is not a tty, skipping serial configuration", name().c_str(), device());
+		return fd;
+	}
+
 	/* enable RTS as supply for infrared adapters */
 	ioctl(fd, TIOCMGET, &bits);
 	bits |= TIOCM_RTS;
@@ -0,0 +1,463 @@
+/**
+ * Connections to modbus gateways and serial lines shared by several meters
+ *
+ * @package vzlogger
+ * @copyright Copyright (c) 2013, The volkszaehler.org project
+ * @license http://www.gnu.org/licenses/gpl.txt GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <set>
+#include <sstream>
+
+#include <protocols/ModbusConnection.hpp>
+#include <common.h>
+
+#define MODBUS_MBAP_LEN 7	/* transaction id, protocol id, length, unit id */
+#define MODBUS_MAX_PDU_LEN 253
+
+std::map<std::string, vz::weak_ptr<ModbusConnection> > ModbusConnection::_registry;
+pthread_mutex_t ModbusConnection::_registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+ModbusConnection::Ptr ModbusConnection::tcp(const std::string &ip, int port) {
+	std::ostringstream name;
+	bool created;
+
+	name << ip << ":" << port;
+	Ptr conn = _lookup(name.str(), created);
+	if (created) {
+		conn->_rtu = false;
+		conn->_host = ip;
+		conn->_port = port;
+	}
+
+	return conn;
+}
+
+ModbusConnection::Ptr ModbusConnection::rtu(const std::string &device, int baudrate, char parity, int databits, int stopbits) {
+	bool created;
+
+	Ptr conn = _lookup(device, created);
+	if (created) {
+		conn->_rtu = true;
+		conn->_baudrate = baudrate;
+		conn->_parity = parity;
+		conn->_databits = databits;
+		conn->_stopbits = stopbits;
+	}
+	else if (!conn->_rtu || conn->_baudrate != baudrate || conn->_parity != parity ||
+			conn->_databits != databits || conn->_stopbits != stopbits) {
+		print(log_warning, "Line settings differ from other meters on %s, using the first ones", "modbus", device.c_str());
+	}
+
+	return conn;
+}
+
+ModbusConnection::Ptr ModbusConnection::_lookup(const std::string &name, bool &created) {
+	Ptr conn;
+
+	pthread_mutex_lock(&_registry_mutex);
+	std::map<std::string, vz::weak_ptr<ModbusConnection> >::iterator it = _registry.find(name);
+	if (it != _registry.end()) {
+		conn = it->second.lock();
+	}
+
+	created = !conn;
+	if (created) {
+		conn = Ptr(new ModbusConnection(name));
+		_registry[name] = conn;
+	}
+	else {
+		print(log_debug, "Sharing connection to %s", "modbus", name.c_str());
+	}
+	pthread_mutex_unlock(&_registry_mutex);
+
+	return conn;
+}
+
+ModbusConnection::ModbusConnection(const std::string &name)
+		: _name(name)
+		, _rtu(false)
+		, _port(MODBUS_TCP_DEFAULT_PORT)
+		, _mb(NULL)
+		, _connected(false)
+		, _tid(0)
+		, _next(0)
+		, _serving(0)
+{
+	_timeout.tv_sec = 0;
+	_timeout.tv_usec = 500000;
+
+	pthread_mutex_init(&_mutex, NULL);
+	pthread_cond_init(&_cond, NULL);
+}
+
+ModbusConnection::~ModbusConnection() {
+	disconnect();
+
+	pthread_mutex_lock(&_registry_mutex);
+	std::map<std::string, vz::weak_ptr<ModbusConnection> >::iterator it = _registry.find(_name);
+	if (it != _registry.end() && it->second.expired()) {
+		_registry.erase(it);
+	}
+	pthread_mutex_unlock(&_registry_mutex);
+
+	pthread_cond_destroy(&_cond);
+	pthread_mutex_destroy(&_mutex);
+}
+
+void ModbusConnection::lock() {
+	pthread_mutex_lock(&_mutex);
+	unsigned long ticket = _next++;
+	while (ticket != _serving) {
+		pthread_cond_wait(&_cond, &_mutex);
+	}
+	pthread_mutex_unlock(&_mutex);
+}
+
+void ModbusConnection::unlock() {
+	pthread_mutex_lock(&_mutex);
+	_serving++;
+	pthread_cond_broadcast(&_cond);
+	pthread_mutex_unlock(&_mutex);
+}
+
+int ModbusConnection::connect(const struct timeval &timeout) {
+	if (_connected) {
+		return SUCCESS;
+	}
+
+	if (_rtu) {
+		_mb = modbus_new_rtu(_name.c_str(), _baudrate, _parity, _databits, _stopbits);
+	}
+	else {
+		_mb = modbus_new_tcp(_host.c_str(), _port);
+	}
+
+	if (_mb == NULL) {
+		print(log_error, "Unable to allocate libmodbus context for %s: %s", "modbus", _name.c_str(), modbus_strerror(errno));
+		return ERR;
+	}
+
+	_timeout = timeout;
+	modbus_set_response_timeout(_mb, &_timeout);
+
+	if (_rtu) {
+		print(log_debug, "Opening %s (%d baud, %d%c%d)", "modbus", _name.c_str(), _baudrate, _databits, _parity, _stopbits);
+	}
+	else {
+		print(log_debug, "Connecting to %s", "modbus", _name.c_str());
+	}
+
+	if (modbus_connect(_mb) == -1) {
+		print(log_error, "Connection to %s failed: %s", "modbus", _name.c_str(), modbus_strerror(errno));
+		modbus_free(_mb);
+		_mb = NULL;
+		return ERR;
+	}
+
+	_connected = true;
+	return SUCCESS;
+}
+
+void ModbusConnection::disconnect() {
+	if (_mb != NULL) {
+		modbus_close(_mb);
+		modbus_free(_mb);
+		_mb = NULL;
+	}
+	_connected = false;
+}
+
+void ModbusConnection::transfer(std::vector<request_t> &requests, int depth) {
+	if (!_connected) {
+		for (std::vector<request_t>::iterator req = requests.begin(); req != requests.end(); req++) {
+			req->rc = -1;
+			req->error = ECONNRESET;
+		}
+		return;
+	}
+
+	if (_rtu || depth <= 1) {
+		_sequential(requests);
+	}
+	else {
+		_pipelined(requests, depth);
+	}
+}
+
+/**
+ * Decides whether the connection or only a single slave failed
+ */
+static bool is_connection_error(int error) {
+	return (error == ECONNRESET || error == EPIPE || error == ENOTCONN);
+}
+
+void ModbusConnection::_sequential(std::vector<request_t> &requests) {
+	std::set<int> failed;
+	int current_slave = -1;
+	int error = 0;
+
+	for (std::vector<request_t>::iterator req = requests.begin(); req != requests.end(); req++) {
+		req->rc = -1;
+
+		if (error) { /* connection lost */
+			req->error = error;
+			continue;
+		}
+
+		if (failed.count(req->slave)) { /* keep the bus busy with the remaining slaves */
+			req->error = ETIMEDOUT;
+			continue;
+		}
+
+		if (req->slave != current_slave) {
+			modbus_set_slave(_mb, req->slave);
+			current_slave = req->slave;
+		}
+
+		switch (req->function_code) {
+				case 3:  req->rc = modbus_read_registers(_mb, req->start, req->count, req->regs); break;
+				case 4:  req->rc = modbus_read_input_registers(_mb, req->start, req->count, req->regs); break;
+				case 1:  req->rc = modbus_read_bits(_mb, req->start, req->count, req->bits); break;
+				case 2:  req->rc = modbus_read_input_bits(_mb, req->start, req->count, req->bits); break;
+				default: errno = EINVAL;
+		}
+
+		if (req->rc == -1) {
+			req->error = errno;
+
+			if (is_connection_error(errno)) {
+				error = errno;
+				disconnect();
+			}
+			else if (errno != EMBXILADD) {
+				failed.insert(req->slave);
+				if (_mb) modbus_flush(_mb);
+			}
+		}
+	}
+}
+
+void ModbusConnection::_pipelined(std::vector<request_t> &requests, int depth) {
+	std::vector<uint16_t> tids(requests.size());
+	std::set<int> failed;
+	size_t next = 0;	/* next request to send */
+	size_t first = 0;	/* oldest outstanding request */
+	int outstanding = 0;
+	int fd = modbus_get_socket(_mb);
+
+	for (size_t i = 0; i < requests.size(); i++) {
+		requests[i].rc = -1;
+		requests[i].error = ETIMEDOUT;
+	}
+
+	while (next < requests.size() || outstanding > 0) {
+		uint8_t frame[MODBUS_MBAP_LEN + MODBUS_MAX_PDU_LEN];
+		size_t len = 0;
+		uint16_t tid;
+
+		/* fill the pipeline */
+		while (outstanding < depth && next < requests.size()) {
+			request_t &req = requests[next];
+
+			if (failed.count(req.slave) == 0) {
+				tids[next] = _tid++;
+				if (_send(fd, req, tids[next]) != 0) {
+					req.error = errno;
+					goto connection_error;
+				}
+				req.error = EINPROGRESS;
+				outstanding++;
+			}
+			next++;
+		}
+
+		if (outstanding == 0) {
+			continue;
+		}
+
+		/* wait for a response */
+		if (_recv(fd, frame, MODBUS_MBAP_LEN) != 0) {
+			goto receive_error;
+		}
+
+		len = (frame[4] << 8) | frame[5];
+		if (len < 2 || len > MODBUS_MAX_PDU_LEN + 1) {
+			errno = EMBBADDATA;
+			goto receive_error;
+		}
+		if (_recv(fd, frame + MODBUS_MBAP_LEN, len - 1) != 0) {
+			goto receive_error;
+		}
+
+		/* match the response to an outstanding request */
+		tid = (frame[0] << 8) | frame[1];
+		for (size_t i = first; i < next; i++) {
+			request_t &req = requests[i];
+
+			if (req.error == EINPROGRESS && tids[i] == tid) {
+				if (frame[6] != (req.slave & 0xff)) {
+					req.rc = -1;
+					req.error = EMBBADDATA; /* _decode() is skipped, the request must not stay in progress */
+					print(log_warning, "Invalid response from %s for slave %d", "modbus", _name.c_str(), req.slave);
+				}
+				else if (!_decode(req, frame + MODBUS_MBAP_LEN, len - 1)) {
+					print(log_warning, "Invalid response from %s for slave %d", "modbus", _name.c_str(), req.slave);
+				}
+				if (req.rc == -1 && req.error != EMBXILADD) {
+					failed.insert(req.slave);
+				}
+				outstanding--;
+				break;
+			}
+		}
+
+		while (first < next && requests[first].error != EINPROGRESS) {
+			first++;
+		}
+		continue;
+
+	receive_error:
+		if (is_connection_error(errno)) {
+			goto connection_error;
+		}
+
+		/* a response is missing: give up on all outstanding requests */
+		for (size_t i = first; i < next; i++) {
+			if (requests[i].error == EINPROGRESS) {
+				requests[i].error = errno;
+				failed.insert(requests[i].slave);
+			}
+		}
+		outstanding = 0;
+		first = next;
+		modbus_flush(_mb); /* discard late responses */
+	}
+
+	return;
+
+connection_error:
+	int error = is_connection_error(errno) ? errno : ECONNRESET;
+	for (size_t i = 0; i < requests.size(); i++) {
+		if (requests[i].rc == -1 && (requests[i].error == EINPROGRESS || i >= next)) {
+			requests[i].error = error;
+		}
+	}
+	print(log_error, "Lost connection to %s: %s", "modbus", _name.c_str(), strerror(error));
+	disconnect();
+}
+
+int ModbusConnection::_send(int fd, const request_t &req, uint16_t tid) {
+	uint8_t frame[MODBUS_MBAP_LEN + 5] = {
+		(uint8_t) (tid >> 8), (uint8_t) tid,
+		0, 0,				/* protocol id */
+		0, 6,				/* length */
+		(uint8_t) req.slave,
+		(uint8_t) req.function_code,
+		(uint8_t) (req.start >> 8), (uint8_t) req.start,
+		(uint8_t) (req.count >> 8), (uint8_t) req.count
+	};
+
+	size_t sent = 0;
+	while (sent < sizeof(frame)) {
+		ssize_t bytes = send(fd, frame + sent, sizeof(frame) - sent, MSG_NOSIGNAL);
+		if (bytes < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		sent += bytes;
+	}
+
+	return 0;
+}
+
+int ModbusConnection::_recv(int fd, uint8_t *buffer, size_t len) {
+	struct pollfd pfd;
+	int timeout = _timeout.tv_sec * 1000 + _timeout.tv_usec / 1000;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+
+	while (len > 0) {
+		int rc = poll(&pfd, 1, timeout);
+		if (rc < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		else if (rc == 0) {
+			errno = ETIMEDOUT;
+			return -1;
+		}
+
+		ssize_t bytes = recv(fd, buffer, len, 0);
+		if (bytes < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		else if (bytes == 0) { /* closed by peer */
+			errno = ECONNRESET;
+			return -1;
+		}
+
+		buffer += bytes;
+		len -= bytes;
+	}
+
+	return 0;
+}
+
+bool ModbusConnection::_decode(request_t &req, const uint8_t *pdu, size_t len) {
+	req.rc = -1;
+	req.error = EMBBADDATA;
+
+	if (len >= 2 && pdu[0] == (req.function_code | 0x80)) { /* exception response */
+		req.error = MODBUS_ENOBASE + pdu[1];
+		return true;
+	}
+
+	if (len < 2 || pdu[0] != req.function_code) {
+		return false;
+	}
+
+	size_t bytes = pdu[1];
+	bool bits = (req.function_code == 1 || req.function_code == 2);
+	size_t expected = bits ? (req.count + 7) / 8 : req.count * 2;
+
+	if (bytes != expected || len < 2 + bytes) {
+		return false;
+	}
+
+	for (int i = 0; i < req.count; i++) {
+		if (bits) {
+			req.bits[i] = (pdu[2 + i / 8] >> (i % 8)) & 1;
+		}
+		else {
+			req.regs[i] = (pdu[2 + 2 * i] << 8) | pdu[3 + 2 * i];
+		}
+	}
+
+	req.rc = req.count;
+	req.error = 0;
+	return true;
+}
@@ -0,0 +1,142 @@
+/**
+ * Protocol generic interface
+ *
+ * @package vzlogger
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @license http://www.gnu.org/licenses/gpl.txt GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+
+/* socket */
+#include <netdb.h>
+#include <sys/socket.h>
+
+#include "protocols/Protocol.hpp"
+
+int vz::protocol::Protocol::connect(const char *node, const char *service, int timeout) {
+	struct addrinfo hints, *ais, *ai;
+	int fd = ERR;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	int rc = getaddrinfo(node, service, &hints, &ais);
+	if (rc != 0) {
+		print(log_error, "getaddrinfo(%s, %s): %s", name().c_str(), node, service, gai_strerror(rc));
+		return ERR;
+	}
+
+	for (ai = ais; ai != NULL; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0) {
+			print(log_error, "socket(): %s", name().c_str(), strerror(errno));
+			continue;
+		}
+
+		/* connect without blocking, so an unreachable host cannot stall us for minutes */
+		int flags = fcntl(fd, F_GETFL);
+		fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+		rc = ::connect(fd, ai->ai_addr, ai->ai_addrlen);
+		if (rc < 0 && errno == EINPROGRESS) {
+			struct pollfd pfd = { fd, POLLOUT, 0 };
+
+			rc = poll(&pfd, 1, timeout);
+			if (rc == 0) {
+				errno = ETIMEDOUT;
+				rc = -1;
+			}
+			else if (rc > 0) {
+				int error;
+				socklen_t len = sizeof(error);
+
+				getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len);
+				errno = error;
+				rc = (error == 0) ? 0 : -1;
+			}
+		}
+
+		if (rc == 0) {
+			fcntl(fd, F_SETFL, flags); /* readers expect a blocking socket */
+			break;
+		}
+
+		print(log_error, "connect(%s, %s): %s", name().c_str(), node, service, strerror(errno));
+		::close(fd);
+		fd = ERR;
+	}
+
+	freeaddrinfo(ais);
+
+	return fd;
+}
+
+bool vz::protocol::Protocol::lost(ssize_t bytes) {
+	if (bytes > 0 || (bytes < 0 && (errno == EINTR || errno == EAGAIN))) {
+		return false;
+	}
+
+	if (bytes == 0) {
+		print(log_error, "Connection closed by the meter", name().c_str());
+	}
+	else {
+		print(log_error, "Connection lost: %s", name().c_str(), strerror(errno));
+	}
+	_connected = false;
+
+	return true;
+}
+
+bool vz::protocol::Protocol::readable(int fd) {
+	struct pollfd pfd = { fd, POLLIN | POLLRDHUP, 0 };
+	int rc;
+
+	do {
+		rc = poll(&pfd, 1, _deadline);
+	} while (rc < 0 && errno == EINTR);
+
+	if (rc < 0) {
+		return !lost(rc);
+	}
+	else if (rc == 0) {
+		print(log_error, "No data from the meter for %.1f seconds", name().c_str(), _deadline / 1e3);
+		_connected = false;
+		return false;
+	}
+
+	/* a hangup or end of file is signalled as readable without any data */
+	if (!(pfd.revents & (POLLRDHUP | POLLHUP | POLLERR | POLLNVAL))) {
+		return true;
+	}
+	if (pfd.revents & POLLIN) {
+		int avail;
+		if (ioctl(fd, FIONREAD, &avail) < 0 || avail > 0) {
+			return true;
+		}
+	}
+
+	return !lost(0);
+}
@@ -0,0 +1,302 @@
+/**
+ * Streaming decoder for the smart message language (SML)
+ *
+ * @package vzlogger
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @license http://www.gnu.org/licenses/gpl.txt GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "protocols/SmlDecoder.hpp"
+#include <common.h>
+#include <Clock.hpp>
+
+#define SML_MESSAGE_GET_LIST_RESPONSE 0x0701
+#define SML_TIME_TIMESTAMP 0x02
+#define SML_TIME_LOCAL_TIMESTAMP 0x03
+#define SML_MAX_DEPTH 16               /* limit recursion on malformed files */
+#define SML_MAX_IDENTIFIERS 256        /* stop interning to limit memory usage */
+
+/* exactly representable powers of ten */
+static const double pow10_table[] = {
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static double scale(double value, int scaler) {
+	if (scaler >= 0 && scaler <= 22) {
+		return value * pow10_table[scaler];
+	}
+	else if (scaler < 0 && scaler >= -22) {
+		return value / pow10_table[-scaler];
+	}
+	else {
+		return value * pow(10, scaler);
+	}
+}
+
+SmlDecoder::SmlDecoder() {
+}
+
+size_t SmlDecoder::decode(const unsigned char *buffer, size_t len, std::vector<Reading> &rds, size_t n) {
+	cursor_t cur = { buffer, buffer + len };
+	size_t m = 0;
+
+	vz::Clock::gettimeofday(&_now);
+
+	while (cur.p < cur.end && m < n) {
+		if (*cur.p == 0x00) { /* padding between messages */
+			cur.p++;
+			continue;
+		}
+
+		if (!_message(cur, rds, n, m)) {
+			print(log_warning, "Malformed SML file at offset %d", "sml", (int) (cur.p - buffer));
+			break;
+		}
+	}
+
+	return m;
+}
+
+bool SmlDecoder::_tl(cursor_t &cur, int &type, size_t &len) {
+	if (cur.p >= cur.end) return false;
+
+	type = *cur.p & 0x70;
+	len = 0;
+	int bytes = 0;
+
+	for (;;) {
+		unsigned char byte = *cur.p++;
+		len = (len << 4) | (byte & 0x0f);
+		bytes++;
+
+		if ((byte & 0x80) == 0) break;
+		if (cur.p >= cur.end || bytes > 4) return false;
+	}
+
+	if (type != sml_list) { /* length includes the type-length field itself */
+		if (len < (size_t) bytes) return false;
+		len -= bytes;
+		if (len > (size_t) (cur.end - cur.p)) return false;
+	}
+
+	return true;
+}
+
+bool SmlDecoder::_skip(cursor_t &cur, int depth) {
+	int type;
+	size_t len;
+
+	if (depth > SML_MAX_DEPTH || !_tl(cur, type, len)) return false;
+
+	if (type == sml_list) {
+		for (size_t i = 0; i < len; i++) {
+			if (!_skip(cur, depth + 1)) return false;
+		}
+	}
+	else {
+		cur.p += len;
+	}
+
+	return true;
+}
+
+bool SmlDecoder::_integer(cursor_t &cur, int64_t &value, bool &present, bool &is_unsigned) {
+	int type;
+	size_t len;
+
+	if (!_tl(cur, type, len)) return false;
+
+	present = (len > 0);
+	is_unsigned = (type != sml_integer);
+
+	if (type == sml_list) return false;
+	if (type == sml_octet_string || len > 8) { /* not a number */
+		present = false;
+		cur.p += len;
+		return true;
+	}
+
+	uint64_t raw = 0;
+	for (size_t i = 0; i < len; i++) {
+		raw = (raw << 8) | *cur.p++;
+	}
+
+	if (!is_unsigned && len > 0 && len < 8 && (raw & (1ULL << (len * 8 - 1)))) {
+		raw |= ~0ULL << (len * 8); /* sign extension */
+	}
+
+	value = (int64_t) raw;
+	return true;
+}
+
+bool SmlDecoder::_message(cursor_t &cur, std::vector<Reading> &rds, size_t n, size_t &m) {
+	int type;
+	size_t len;
+	int64_t tag;
+	bool present, is_unsigned;
+
+	/* transactionId, groupNo, abortOnError, messageBody, crc16, endOfSmlMsg */
+	if (!_tl(cur, type, len) || type != sml_list || len != 6) return false;
+	for (int i = 0; i < 3; i++) {
+		if (!_skip(cur)) return false;
+	}
+
+	/* messageBody: choice of tag and body */
+	if (!_tl(cur, type, len) || type != sml_list || len != 2) return false;
+	if (!_integer(cur, tag, present, is_unsigned)) return false;
+
+	if (present && tag == SML_MESSAGE_GET_LIST_RESPONSE) {
+		if (!_list_response(cur, rds, n, m)) return false;
+	}
+	else if (!_skip(cur)) {
+		return false;
+	}
+
+	/* crc16 */
+	if (!_skip(cur)) return false;
+
+	/* endOfSmlMsg */
+	if (cur.p >= cur.end || *cur.p != 0x00) return false;
+	cur.p++;
+
+	return true;
+}
+
+bool SmlDecoder::_list_response(cursor_t &cur, std::vector<Reading> &rds, size_t n, size_t &m) {
+	int type;
+	size_t len, entries;
+
+	/* clientId, serverId, listName, actSensorTime, valList, listSignature, actGatewayTime */
+	if (!_tl(cur, type, len) || type != sml_list || len != 7) return false;
+	for (int i = 0; i < 4; i++) {
+		if (!_skip(cur)) return false;
+	}
+
+	if (!_tl(cur, type, entries) || type != sml_list) return false;
+	for (size_t i = 0; i < entries; i++) {
+		if (m >= n) { /* no space left, skip remaining entries */
+			if (!_skip(cur)) return false;
+			continue;
+		}
+
+		bool valid;
+		if (!_entry(cur, rds[m], valid)) return false;
+		if (valid) m++;
+	}
+
+	for (int i = 0; i < 2; i++) {
+		if (!_skip(cur)) return false;
+	}
+
+	return true;
+}
+
+bool SmlDecoder::_entry(cursor_t &cur, Reading &rd, bool &valid) {
+	int type;
+	size_t len;
+	const unsigned char *obis;
+	int64_t value = 0, scaler = 0, timestamp = 0;
+	bool present, is_unsigned, has_value, has_scaler, has_time = false;
+
+	valid = false;
+
+	/* objName, status, valTime, unit, scaler, value, valueSignature */
+	if (!_tl(cur, type, len) || type != sml_list || len != 7) return false;
+
+	if (!_tl(cur, type, len) || type != sml_octet_string) return false;
+	obis = cur.p;
+	cur.p += len;
+	bool has_obis = (len == 6);
+
+	if (!_skip(cur)) return false; /* status */
+
+	/* valTime: optional choice of secIndex, timestamp or localTimestamp */
+	if (cur.p < cur.end && (*cur.p & 0x70) == sml_list) {
+		int64_t tag;
+
+		if (!_tl(cur, type, len) || len != 2) return false;
+		if (!_integer(cur, tag, present, is_unsigned)) return false;
+
+		if (tag == SML_TIME_TIMESTAMP) {
+			if (!_integer(cur, timestamp, has_time, is_unsigned)) return false;
+		}
+		else if (tag == SML_TIME_LOCAL_TIMESTAMP) {
+			if (!_tl(cur, type, len) || type != sml_list || len == 0) return false;
+			if (!_integer(cur, timestamp, has_time, is_unsigned)) return false;
+			for (size_t i = 1; i < len; i++) {
+				if (!_skip(cur)) return false;
+			}
+		}
+		else if (!_skip(cur)) { /* seconds index is not a wall clock time */
+			return false;
+		}
+	}
+	else if (!_skip(cur)) {
+		return false;
+	}
+
+	if (!_skip(cur)) return false; /* unit */
+	if (!_integer(cur, scaler, has_scaler, is_unsigned)) return false;
+	if (!_integer(cur, value, has_value, is_unsigned)) return false;
+	if (!_skip(cur)) return false; /* valueSignature */
+
+	if (!has_obis || !has_value) { /* skip non-numeric entries like the server id */
+		return true;
+	}
+
+	double v = is_unsigned ? (double) (uint64_t) value : (double) value;
+	rd.value(has_scaler ? scale(v, (int) scaler) : v);
+	rd.identifier(_intern(obis));
+
+	if (has_time) { /* use time from meter */
+		struct timeval tv;
+		tv.tv_sec = (time_t) timestamp;
+		tv.tv_usec = 0;
+		rd.time(tv);
+	}
+	else {
+		rd.time(_now); /* use local time */
+	}
+
+	valid = true;
+	return true;
+}
+
+ReadingIdentifier::Ptr SmlDecoder::_intern(const unsigned char *obis) {
+	for (std::vector<intern_t>::const_iterator it = _identifiers.begin(); it != _identifiers.end(); it++) {
+		if (memcmp(it->obis, obis, 6) == 0) {
+			return it->id;
+		}
+	}
+
+	ReadingIdentifier::Ptr id(new ObisIdentifier(Obis(obis[0], obis[1], obis[2], obis[3], obis[4], obis[5])));
+	if (_identifiers.size() < SML_MAX_IDENTIFIERS) {
+		intern_t entry;
+		memcpy(entry.obis, obis, 6);
+		entry.id = id;
+		_identifiers.push_back(entry);
+	}
+
+	return id;
+}
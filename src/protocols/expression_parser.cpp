@@ -10,26 +10,99 @@
 #include <protocols/expression_parser.hpp>
 
 double parse_expression( const char *expr ){
-	double val;
-	parser_data *pd = parser_data_new( expr );
-	val = parser_parse( pd );
-	
-	// if pd->error is non-NULL, an error occured, print out the error string
-	if( pd->error ){
-		print(log_error,"Error: %s\n","Expression Parser", pd->error );
+	expression_program prog;
+	const char *error;
+
+	if( expression_compile( expr, &prog, &error ) != 0 ){
+		print(log_error,"Error: %s\n","Expression Parser", error );
 		print(log_error,"Expression failed to parse, returning nan", "Expression Parser");
+		return sqrt( -1.0 );
+	}
+
+	// expressions without a variable are constant
+	return expression_evaluate( &prog, sqrt( -1.0 ) );
+}
+
+int expression_compile( const char *expr, expression_program *prog, const char **error ){
+	int rc = 0;
+	parser_data *pd = parser_data_new( expr );
+	if( !pd ){
+		*error = "Out of memory!";
+		return -1;
+	}
+
+	prog->len = 0;
+	prog->stack = 0;
+	pd->prog = prog;
+
+	if( parser_parse( pd ) != 0 ){
+		*error = pd->error;
+		rc = -1;
 	}
 	parser_data_free( pd );
-	return val;
+	return rc;
+}
+
+double expression_evaluate( const expression_program *prog, double var ){
+	double stack[EXPRESSION_MAX_STACK];
+	int sp = -1;
+
+	for( uint32_t i = 0; i < prog->len; i++ ){
+		const expression_instr *in = &prog->code[i];
+		switch( in->op ){
+			case EXPR_PUSH:  stack[++sp] = in->value; break;
+			case EXPR_VAR:   stack[++sp] = var; break;
+			case EXPR_NEG:   stack[sp] = -stack[sp]; break;
+			case EXPR_ADD:   sp--; stack[sp] += stack[sp+1]; break;
+			case EXPR_SUB:   sp--; stack[sp] -= stack[sp+1]; break;
+			case EXPR_MUL:   sp--; stack[sp] *= stack[sp+1]; break;
+			case EXPR_DIV:   sp--; stack[sp] /= stack[sp+1]; break;
+			case EXPR_POW:   sp--; stack[sp] = pow( stack[sp], stack[sp+1] ); break;
+			case EXPR_ATAN2: sp--; stack[sp] = atan2( stack[sp], stack[sp+1] ); break;
+			case EXPR_SQRT:
+				if( stack[sp] < 0.0 ) return sqrt( -1.0 ); // sqrt(x) undefined for x < 0
+				stack[sp] = sqrt( stack[sp] );
+				break;
+			case EXPR_LOG:
+				if( stack[sp] <= 0.0 ) return sqrt( -1.0 ); // log(x) undefined for x <= 0
+				stack[sp] = log( stack[sp] );
+				break;
+			case EXPR_ASIN:
+				if( fabs( stack[sp] ) > 1.0 ) return sqrt( -1.0 ); // asin(x) undefined for |x| > 1
+				stack[sp] = asin( stack[sp] );
+				break;
+			case EXPR_ACOS:
+				if( fabs( stack[sp] ) > 1.0 ) return sqrt( -1.0 ); // acos(x) undefined for |x| > 1
+				stack[sp] = acos( stack[sp] );
+				break;
+			case EXPR_EXP:   stack[sp] = exp( stack[sp] ); break;
+			case EXPR_SIN:   stack[sp] = sin( stack[sp] ); break;
+			case EXPR_COS:   stack[sp] = cos( stack[sp] ); break;
+			case EXPR_TAN:   stack[sp] = tan( stack[sp] ); break;
+			case EXPR_ATAN:  stack[sp] = atan( stack[sp] ); break;
+			case EXPR_ABS:   stack[sp] = fabs( stack[sp] ); break;
+			case EXPR_FLOOR: stack[sp] = floor( stack[sp] ); break;
+			case EXPR_CEIL:  stack[sp] = ceil( stack[sp] ); break;
+			case EXPR_ROUND: stack[sp] = round( stack[sp] ); break;
+		}
+	}
+
+	return stack[0];
 }
 
-double parser_parse( parser_data *pd ){
+int parser_parse( parser_data *pd ){
 	// set the jump position and launch the parser
 	if( !setjmp( pd->err_jmp_buf ) ){
-		return parser_read_expr( pd );
+		parser_eat_whitespace( pd );
+		parser_read_expr( pd );
+
+		// the whole input has to be consumed
+		if( parser_peek( pd ) != '\0' )
+			parser_error( pd, "Unexpected character in expression!" );
+		return 0;
 	} else {
-		// error was returned, output a nan silently
-		return sqrt( -1.0 );
+		// error was returned
+		return -1;
 	}
 }
 
@@ -40,6 +113,8 @@ parser_data *parser_data_new( const char *str ){
 	pd->len = strlen( str )+1;
 	pd->pos = 0;
 	pd->error = NULL;
+	pd->prog = NULL;
+	pd->depth = 0;
 	return pd;
 }
 
@@ -52,6 +127,35 @@ void parser_error( parser_data *pd, const char *err ){
 	longjmp( pd->err_jmp_buf, 1);
 }
 
+void parser_emit( parser_data *pd, expression_op op, double value ){
+	expression_program *prog = pd->prog;
+
+	if( prog->len >= EXPRESSION_MAX_CODE )
+		parser_error( pd, "Expression too long!" );
+
+	// track the stack depth required by the evaluator
+	switch( op ){
+		case EXPR_PUSH:
+		case EXPR_VAR:
+			pd->depth++;
+			break;
+		case EXPR_ADD: case EXPR_SUB: case EXPR_MUL: case EXPR_DIV:
+		case EXPR_POW: case EXPR_ATAN2:
+			pd->depth--;
+			break;
+		default:
+			break;
+	}
+	if( pd->depth > EXPRESSION_MAX_STACK )
+		parser_error( pd, "Expression nested too deeply!" );
+	if( (uint32_t) pd->depth > prog->stack )
+		prog->stack = pd->depth;
+
+	prog->code[prog->len].op = op;
+	prog->code[prog->len].value = value;
+	prog->len++;
+}
+
 char parser_peek( parser_data *pd ){
 	if( pd->pos < pd->len )
 		return pd->str[pd->pos];
@@ -71,31 +175,68 @@ void parser_eat_whitespace( parser_data *pd ){
 		parser_eat( pd );
 }
 
-double parser_read_double( parser_data *pd ){
+void parser_read_variable( parser_data *pd ){
+	char c;
+
+	// skip the '%'
+	parser_eat( pd );
+
+	// skip optional flags, field width, precision and length modifiers
+	c = parser_peek( pd );
+	while( c != '\0' && strchr( "-+ #0123456789.hl", c ) ){
+		parser_eat( pd );
+		c = parser_peek( pd );
+	}
+
+	// the conversion of the register value
+	if( c == '\0' || !strchr( "udifeg", c ) )
+		parser_error( pd, "Expected %u, %d, %i, %f, %e or %g as variable!" );
+	parser_eat( pd );
+
+	parser_emit( pd, EXPR_VAR, 0.0 );
+}
+
+void parser_read_double( parser_data *pd ){
 	char c, token[PARSER_MAX_TOKEN_SIZE];
-	uint16_t pos=0;
+	uint16_t pos=0, digits=0;
 	
 	// read a leading sign
 	c = parser_peek( pd );
 	if( c == '+' || c == '-' )
 		token[pos++] = parser_eat( pd );
+
+	// a signed variable instead of a literal
+	if( parser_peek( pd ) == '%' ){
+		parser_read_variable( pd );
+		if( pos > 0 && token[0] == '-' )
+			parser_emit( pd, EXPR_NEG, 0.0 );
+		parser_eat_whitespace( pd );
+		return;
+	}
 	
 	// read optional digits leading the decimal point
-	while( isdigit(parser_peek(pd)) )
+	while( isdigit(parser_peek(pd)) && pos < PARSER_MAX_TOKEN_SIZE-1 ){
 		token[pos++] = parser_eat( pd );
+		digits++;
+	}
 	
 	// read the optional decimal point
 	c = parser_peek( pd );
-	if( c == '.' )
+	if( c == '.' && pos < PARSER_MAX_TOKEN_SIZE-1 )
 		token[pos++] = parser_eat( pd );
 	
 	// read optional digits after the decimal point
-	while( isdigit(parser_peek(pd)) )
+	while( isdigit(parser_peek(pd)) && pos < PARSER_MAX_TOKEN_SIZE-1 ){
 		token[pos++] = parser_eat( pd );
+		digits++;
+	}
+
+	if( digits == 0 )
+		parser_error( pd, "Expected a number!" );
 	
 	// read the exponent delimiter
 	c = parser_peek( pd );
-	if( c == 'e' || c == 'E' ){
+	if( ( c == 'e' || c == 'E' ) && pos < PARSER_MAX_TOKEN_SIZE-2 ){
 		token[pos++] = parser_eat( pd );
 		
 		// check if the expoentn has a sign,
@@ -107,26 +248,25 @@ double parser_read_double( parser_data *pd ){
 	}
 	
 	// read the exponent delimiter
-	while( isdigit(parser_peek(pd) ) )
+	while( isdigit(parser_peek(pd) ) && pos < PARSER_MAX_TOKEN_SIZE-1 )
 		token[pos++] = parser_eat( pd );
 	
 	// remove any trailing whitespace
 	parser_eat_whitespace( pd );
 	
-	// null-terminate the string and return 
-	// the converted result as a double
+	// null-terminate the string and emit
+	// the converted result as a constant
 	token[pos] = '\0';
-	return atof( token );
+	parser_emit( pd, EXPR_PUSH, atof( token ) );
 }
 
-double parser_read_argument( parser_data *pd ){
+void parser_read_argument( parser_data *pd ){
 	char c;
-	double val;
 	// eat leading whitespace
 	parser_eat_whitespace( pd );
 	
 	// read the argument
-	val = parser_read_expr( pd );
+	parser_read_expr( pd );
 	
 	// read trailing whitespace
 	parser_eat_whitespace( pd );
@@ -138,19 +278,15 @@ double parser_read_argument( parser_data *pd ){
 	
 	// eat trailing whitespace
 	parser_eat_whitespace( pd );
-	
-	// return result
-	return val;
 }
 
-double parser_read_builtin( parser_data *pd ){
-	double v0, v1;
+void parser_read_builtin( parser_data *pd ){
 	char c, token[PARSER_MAX_TOKEN_SIZE];
 	int pos=0;
 	
 	c = parser_peek( pd );
 	if( isalpha(c) || c == '_' ){
-		while( isalpha(c) || isdigit(c) || c == '-' ){
+		while( ( isalpha(c) || isdigit(c) || c == '-' ) && pos < PARSER_MAX_TOKEN_SIZE-1 ){
 			token[pos++] = parser_eat( pd );
 			c = parser_peek( pd );
 		}
@@ -162,65 +298,42 @@ double parser_read_builtin( parser_data *pd ){
 		
 		// start handling the specific builtin functions
 		if( strcmp( token, "pow" ) == 0 ){
-			v0 = parser_read_argument( pd );
-			v1 = parser_read_argument( pd );
-			v0 = pow( v0, v1 );
-		} else if( strcmp( token, "sqrt" ) == 0 ){
-			v0 = parser_read_argument( pd );
-			if( v0 < 0.0 ) 
-				parser_error( pd, "sqrt(x) undefined for x < 0!" );
-			v0 = sqrt( v0 );
-		} else if( strcmp( token, "log" ) == 0 ){
-			v0 = parser_read_argument( pd );
-			if( v0 <= 0 )
-				parser_error( pd, "log(x) undefined for x <= 0!" );
-			v0 = log( v0 );
-		} else if( strcmp( token, "exp" ) == 0 ){
-			v0 = parser_read_argument( pd );
-			v0 = exp( v0 );
-		} else if( strcmp( token, "sin" ) == 0 ){
-			v0 = parser_read_argument( pd );	
-			v0 = sin( v0 );
-		} else if( strcmp( token, "asin" ) == 0 ){
-			v0 = parser_read_argument( pd );
-			if( fabs(v0) > 1.0 )
-				parser_error( pd, "asin(x) undefined for |x| > 1!" );
-			v0 = asin( v0 );
-		} else if( strcmp( token, "cos" ) == 0 ){
-			v0 = parser_read_argument( pd );
-			if( fabs(v0 ) > 1.0 )
-				parser_error( pd, "acos(x) undefined for |x| > 1!" );
-			v0 = cos( v0 );
-		} else if( strcmp( token, "acos" ) == 0 ){
-			v0 = parser_read_argument( pd );
-			v0 = acos( v0 );
-		} else if( strcmp( token, "tan" ) == 0 ){
-			v0 = parser_read_argument( pd );	
-			v0 = tan( v0 );
-		} else if( strcmp( token, "atan" ) == 0 ){
-			v0 = parser_read_argument( pd );
-			v0 = atan( v0 );
+			parser_read_argument( pd );
+			parser_read_argument( pd );
+			parser_emit( pd, EXPR_POW, 0.0 );
 		} else if( strcmp( token, "atan2" ) == 0 ){
-			v0 = parser_read_argument( pd );
-			v1 = parser_read_argument( pd );
-			v0 = atan2( v0, v1 );
-		} else if( strcmp( token, "abs" ) == 0 ){
-			v0 = parser_read_argument( pd );
-			v0 = abs( v0 );
-		} else if( strcmp( token, "fabs" ) == 0 ){
-			v0 = parser_read_argument( pd );
-			v0 = fabs( v0 );
-		} else if( strcmp( token, "floor" ) == 0 ){
-			v0 = parser_read_argument( pd );
-			v0 = floor( v0 );
-		} else if( strcmp( token, "ceil" ) == 0 ){
-			v0 = parser_read_argument( pd );
-			v0 = floor( v0 );
-		} else if( strcmp( token, "round" ) == 0 ){
-			v0 = parser_read_argument( pd );
-			v0 = round( v0 );
+			parser_read_argument( pd );
+			parser_read_argument( pd );
+			parser_emit( pd, EXPR_ATAN2, 0.0 );
 		} else {
-			parser_error( pd, "Tried to call unknown builtin function!" );
+			static const struct {
+				const char *name;
+				expression_op op;
+			} builtins[] = {
+				{ "sqrt",  EXPR_SQRT },
+				{ "log",   EXPR_LOG },
+				{ "exp",   EXPR_EXP },
+				{ "sin",   EXPR_SIN },
+				{ "asin",  EXPR_ASIN },
+				{ "cos",   EXPR_COS },
+				{ "acos",  EXPR_ACOS },
+				{ "tan",   EXPR_TAN },
+				{ "atan",  EXPR_ATAN },
+				{ "abs",   EXPR_ABS },
+				{ "fabs",  EXPR_ABS },
+				{ "floor", EXPR_FLOOR },
+				{ "ceil",  EXPR_CEIL },
+				{ "round", EXPR_ROUND },
+				{ NULL,    EXPR_PUSH }
+			};
+			int i;
+
+			for( i = 0; builtins[i].name && strcmp( token, builtins[i].name ) != 0; i++ );
+			if( !builtins[i].name )
+				parser_error( pd, "Tried to call unknown builtin function!" );
+
+			parser_read_argument( pd );
+			parser_emit( pd, builtins[i].op, 0.0 );
 		}
 		
 		// eat closing bracket of function call
@@ -229,19 +342,14 @@ double parser_read_builtin( parser_data *pd ){
 		
 	} else {
 		// not a builtin function call, just read a literal double
-		v0 = parser_read_double( pd );
+		parser_read_double( pd );
 	}
 	
 	// consume whitespace
 	parser_eat_whitespace( pd );
-	
-	// return the value
-	return v0;
 }
 
-double parser_read_paren( parser_data *pd ){
-	double val;
-	
+void parser_read_paren( parser_data *pd ){
 	// check if the expression has a parenthesis
 	if( parser_peek( pd ) == '(' ){
 		// eat the character
@@ -253,7 +361,7 @@ double parser_read_paren( parser_data *pd ){
 		// if there is a parenthesis, read it 
 		// and then read an expression, then
 		// match the closing brace
-		val = parser_read_expr( pd );
+		parser_read_expr( pd );
 		
 		// consume remaining whitespace
 		parser_eat_whitespace( pd );
@@ -264,26 +372,23 @@ double parser_read_paren( parser_data *pd ){
 		parser_eat(pd);
 	} else {
 		// otherwise just read a literal value
-		val = parser_read_builtin( pd );
+		parser_read_builtin( pd );
 	}
 	// eat following whitespace
 	parser_eat_whitespace( pd );
-	
-	// return the result
-	return val;
 }
 
-double parser_read_power( parser_data *pd ){
-	double v0, v1=1.0, s=1.0;
-	
+void parser_read_power( parser_data *pd ){
 	// read the first operand
-	v0 = parser_read_paren( pd );
+	parser_read_paren( pd );
 	
 	// eat remaining whitespace
 	parser_eat_whitespace( pd );
 	
 	// attempt to read the exponentiation operator
 	while( parser_peek(pd) == '^' ){
+		bool negate = false;
+
 		parser_eat(pd );
 		
 		// eat remaining whitespace
@@ -294,30 +399,28 @@ double parser_read_power( parser_data *pd ){
 		// the parenthetical exponent
 		if( parser_peek( pd ) == '-' ){
 			parser_eat( pd );
-			s = -1.0;
+			negate = true;
 			parser_eat_whitespace( pd );
 		}
 		
 		// read the second operand
-		v1 = s*parser_read_power( pd );
+		parser_read_power( pd );
+		if( negate )
+			parser_emit( pd, EXPR_NEG, 0.0 );
 		
 		// perform the exponentiation
-		v0 = pow( v0, v1 );
+		parser_emit( pd, EXPR_POW, 0.0 );
 		
 		// eat remaining whitespace
 		parser_eat_whitespace( pd );
 	}
-	
-	// return the result
-	return v0;
 }
 
-double parser_read_term( parser_data *pd ){
-	double v0;
+void parser_read_term( parser_data *pd ){
 	char c;
 	
 	// read the first operand
-	v0 = parser_read_power( pd );
+	parser_read_power( pd );
 	
 	// eat remaining whitespace
 	parser_eat_whitespace( pd );
@@ -333,11 +436,8 @@ double parser_read_term( parser_data *pd ){
 		parser_eat_whitespace( pd );
 		
 		// perform the appropriate operation
-		if( c == '*' ){
-			v0 *= parser_read_power( pd );
-		} else if( c == '/' ){
-			v0 /= parser_read_power( pd );
-		}
+		parser_read_power( pd );
+		parser_emit( pd, c == '*' ? EXPR_MUL : EXPR_DIV, 0.0 );
 		
 		// eat remaining whitespace
 		parser_eat_whitespace( pd );
@@ -345,11 +445,9 @@ double parser_read_term( parser_data *pd ){
 		// update the character
 		c = parser_peek( pd );
 	}
-	return v0;
 }
 
-double parser_read_expr( parser_data *pd ){
-	double v0 = 0.0;
+void parser_read_expr( parser_data *pd ){
 	char c;
 	
 	// handle unary minus
@@ -357,12 +455,11 @@ double parser_read_expr( parser_data *pd ){
 	if( c == '+' || c == '-' ){
 		parser_eat( pd );
 		parser_eat_whitespace( pd );
-		if( c == '+' )
-			v0 += parser_read_term( pd );
-		else if( c == '-' )
-			v0 -= parser_read_term( pd );
+		parser_read_term( pd );
+		if( c == '-' )
+			parser_emit( pd, EXPR_NEG, 0.0 );
 	} else {
-		v0 = parser_read_term( pd );
+		parser_read_term( pd );
 	}
 	parser_eat_whitespace( pd );
 	
@@ -377,11 +474,8 @@ double parser_read_expr( parser_data *pd ){
 		parser_eat_whitespace( pd );
 		
 		// perform the operation
-		if( c == '+' ){		
-			v0 += parser_read_term( pd );
-		} else if( c == '-' ){
-			v0 -= parser_read_term( pd );
-		}
+		parser_read_term( pd );
+		parser_emit( pd, c == '+' ? EXPR_ADD : EXPR_SUB, 0.0 );
 		
 		// eat whitespace
 		parser_eat_whitespace( pd );
@@ -389,7 +483,4 @@ double parser_read_expr( parser_data *pd ){
 		// update the character being tested in the while loop
 		c = parser_peek( pd );
 	}
-	
-	// return expression result
-	return v0;
 }
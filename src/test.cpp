@@ -3,7 +3,7 @@
 #include <cstdio>
 
 #include "list.h"
-#include "buffer.h"
+#include "Buffer.hpp"
 
 void test_list() {
 	List<int> li;
@@ -28,28 +28,31 @@ void test_buffer() {
 	Buffer buf;
 
 	struct timeval tv;
-	StringIdentifier id;
+	ReadingIdentifier::Ptr id(new StringIdentifier("test"));
 
 	gettimeofday(&tv, NULL);
 
 	for (int i = 0; i < 10; i++) {
-		Reading rd;
-		rd.value = 11*i;
-		rd.time = tv;
-		rd.identifier = &id;
+		Reading rd(11*i, tv, id);
 
 		buf.push(rd);
 	}
 
 	for (Buffer::iterator it = buf.begin(); it != buf.end(); ++it) {
-		printf("%i\n", it->value);
+		printf("%.0f\n", it->value());
 	}
 
-	printf("popped %i\n", buf.pop().value);
-	printf("popped %i\n", buf.pop().value);
+	/* readings are removed once they have been sent */
+	Buffer::iterator it = buf.begin();
+	printf("sent %.0f\n", it->value());
+	it->mark_delete();
+	++it;
+	printf("sent %.0f\n", it->value());
+	it->mark_delete();
+	buf.clean();
 
 	for (Buffer::iterator it = buf.begin(); it != buf.end(); ++it) {
-		printf("%i\n", it->value);
+		printf("%.0f\n", it->value());
 	}
 
 }
@@ -25,6 +25,7 @@
 
 #include <math.h>
 #include <unistd.h>
+#include <algorithm>
 
 #include "Reading.hpp"
 #include "vzlogger.h"
@@ -39,6 +40,40 @@ void reading_thread_cleanup(void *rds) {
 	free(rds);
 }
 
+/**
+ * Open the meter unless it is open already, retrying with an increasing delay
+ *
+ * The caller resets the delay only once the meter delivered readings, so a
+ * meter which drops every connection right away is not reopened in a busy loop.
+ * Single shot runs try only once.
+ *
+ * @param delay seconds to wait before the next attempt, 0 to try immediately
+ * @return false if the meter could not be opened in time
+ */
+static bool open_meter(Meter::Ptr mtr, double &delay) {
+	if (mtr->isOpen()) {
+		return true;
+	}
+
+	while (true) {
+		if (delay > 0) {
+			print(log_warning, "Retrying to open meter in %.0f seconds", mtr->name(), delay);
+			vz::Clock::sleep(delay);
+		}
+		delay = std::min(std::max(2 * delay, 1.0), (double) METER_RETRY_MAX);
+
+		try {
+			mtr->open();
+			print(log_info, "Meter connection established", mtr->name());
+			return true;
+		} catch (vz::ConnectionException &e) {
+			if (!(options.daemon() || options.local()) || vz::Clock::expired()) {
+				return false;
+			}
+		}
+	}
+}
+
 void * reading_thread(void *arg) {
 	std::vector<Reading> rds;
 	MeterMap *mapping = static_cast<MeterMap *>(arg);
@@ -46,8 +81,11 @@ void * reading_thread(void *arg) {
 	time_t last, delta;
 	const meter_details_t *details;
 	size_t n = 0;
+	double backoff = 0; /* delay before reopening the meter */
 
 	details = meter_get_details(mtr->protocolId());
+	bool scheduled = (options.daemon() || options.local()) && details->periodic && mtr->interval() > 0;
+	vz::Timer timer(mtr->interval(), mtr->align());
 
 	/* allocate memory for readings */
 	for(size_t i=0; i< details->max_readings; i++) {
@@ -62,11 +100,28 @@ void * reading_thread(void *arg) {
 
 
 	try {
+		if (!open_meter(mtr, backoff)) {
+			throw vz::ConnectionException("Meter could not be opened");
+		}
+
+		if (scheduled && mtr->align()) {
+			timer.wait(); /* the first reading is already on the grid */
+		}
+
 		do { /* start thread main loop */
+			/* reopen the meter if the connection has been lost */
+			if (!open_meter(mtr, backoff)) {
+				throw vz::ConnectionException("Meter could not be reopened");
+			}
+
 			/* fetch readings from meter and calculate delta */
-			last = time(NULL);
+			last = vz::Clock::time();
 			n = mtr->read(rds, details->max_readings);
-			delta = time(NULL) - last;
+			delta = vz::Clock::time() - last;
+
+			if (n > 0) {
+				backoff = 0;
+			}
 
 			/* dumping meter output */
 			if (options.verbosity() > log_debug) {
@@ -86,6 +141,10 @@ void * reading_thread(void *arg) {
 				print(log_debug, "Updating interval to %i", mtr->name(), delta);
 				mtr->interval(delta);
 			}
+			/* the thread might be cancelled on reload or shutdown, but not while holding a buffer */
+			int cancel_state;
+			pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+
 			/* insert readings into channel queues */
 			for(MeterMap::iterator ch = mapping->begin(); ch!=mapping->end(); ch++) {
 				Reading *add = NULL;
@@ -148,20 +207,30 @@ void * reading_thread(void *arg) {
 					free(dump);
 				}
 			}
+			pthread_setcancelstate(cancel_state, NULL);
 
-			if ((options.daemon() || options.local()) && details->periodic) {
-				print(log_info, "Next reading in %i seconds", mtr->name(), mtr->interval());
-				sleep(mtr->interval());
+			if (scheduled) {
+				print(log_info, "Next reading in %.3f seconds", mtr->name(), mtr->interval());
+				unsigned long skipped = timer.wait();
+				if (skipped > 0) {
+					print(log_warning, "Reading took too long, skipped %lu intervals", mtr->name(), skipped);
+				}
 			}
-		} while (options.daemon() || options.local() || options.logging() );
+		} while ((options.daemon() || options.local() || options.logging()) && !vz::Clock::expired());
+
+		if (vz::Clock::expired()) {
+			print(log_info, "Reached the end of the time-warp", mtr->name());
+		}
 	} catch(std::exception &e) {
 		std::stringstream oss;
 		oss << e.what();
 		print(log_error, "Reading-THREAD - reading Got an exception : %s", mtr->name(), e.what());
+		mapping->finished();
 		pthread_exit(0);
 	}
 
 	print(log_debug, "Stop reading.! ", mtr->name());
+	mapping->finished();
 	//pthread_cleanup_pop(1);
 
 	pthread_exit(0);
@@ -175,8 +244,7 @@ void logging_thread_cleanup(/*void *arg*/) {
 }
 
 void * logging_thread(void *arg) {
-	Channel::Ptr ch;
-	ch.reset(static_cast<Channel *>(arg)); /* casting argument */
+	Channel::Ptr ch = static_cast<Channel *>(arg)->shared_from_this(); /* the MeterMap owns the channel */
 	print(log_debug, "Start logging thread for %s-api. Running as daemon: %s", ch->name(),
 				ch->apiProtocol().c_str(), options.daemon() ? "yes" : "no");
 
@@ -202,7 +270,7 @@ void * logging_thread(void *arg) {
 			print(log_error, "logging thread failed due to: %s", ch->name(), e.what());
 		}
 
-	} while (options.logging());
+	} while (options.logging() && !(ch->draining() && !api->retrying()));
 
 	print(log_debug, "Stop logging.! (daemon=%d)", ch->name(), options.daemon());
 	pthread_exit(0);
@@ -0,0 +1,86 @@
+/**
+ * Helpers shared by the benchmarks
+ *
+ * @package vzlogger
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @license http://www.gnu.org/licenses/gpl.txt GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <time.h>
+#include <new>
+
+#include "bench.hpp"
+
+static unsigned long long _allocations = 0;
+
+log_level_t bench::verbosity = log_error;
+
+double bench::now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+unsigned long long bench::allocations() {
+	return __sync_add_and_fetch(&_allocations, 0);
+}
+
+/* count every allocation of the code under test */
+void *operator new(size_t size) {
+	__sync_fetch_and_add(&_allocations, 1);
+
+	void *p = malloc(size ? size : 1);
+	if (p == NULL) {
+		throw std::bad_alloc();
+	}
+
+	return p;
+}
+
+void *operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void *p) throw() {
+	free(p);
+}
+
+void operator delete[](void *p) throw() {
+	free(p);
+}
+
+/* the daemon's print() writes to the log, the benchmarks only need stderr */
+void print(log_level_t level, const char *format, const char *id, ... ) {
+	if (level > bench::verbosity) {
+		return;
+	}
+
+	va_list args;
+	va_start(args, id);
+	if (id) {
+		fprintf(stderr, "[%s] ", id);
+	}
+	vfprintf(stderr, format, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+}
@@ -0,0 +1,49 @@
+/**
+ * Helpers shared by the benchmarks
+ *
+ * @package vzlogger
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @license http://www.gnu.org/licenses/gpl.txt GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <common.h>
+
+namespace bench {
+	/**
+	 * Messages up to this level are printed by print(), errors only by default
+	 */
+	extern log_level_t verbosity;
+
+	/**
+	 * @return monotonic time in seconds
+	 */
+	double now();
+
+	/**
+	 * Number of calls to operator new so far, in all threads
+	 *
+	 * Allocations with malloc() by C libraries are not counted.
+	 */
+	unsigned long long allocations();
+}
+
+#endif /* _BENCH_H_ */
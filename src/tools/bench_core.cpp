@@ -0,0 +1,441 @@
+/**
+ * Microbenchmarks of the data structures on the hot path
+ *
+ * Every benchmark runs with 1, 2 and N threads and reports the time
+ * per operation as seen by each thread and the allocations per operation.
+ *
+ * @package vzlogger
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @license http://www.gnu.org/licenses/gpl.txt GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <list>
+
+#include "bench.hpp"
+#include <Buffer.hpp>
+#include <Channel.hpp>
+#include <Obis.hpp>
+#include <Options.hpp>
+#include <Reading.hpp>
+#include <VZException.hpp>
+#include <protocols/expression_parser.hpp>
+
+#define BENCH_ITERATIONS 1000000 /* default number of operations per thread */
+#define BENCH_CLEAN 32           /* readings pushed between two clean() calls */
+
+/* recalculations of modbus registers, with the raw value in place of %u */
+static const char *expressions[] = {
+	"%u",
+	"%u * 0.001",
+	"(%u - 32768) / 10.0",
+	"sqrt(%u) * 2.5 + pow(2, 3)",
+	NULL
+};
+
+/* keeps the compiler from optimizing the operations away */
+static volatile int sink;
+
+/* state shared by the threads of one run */
+typedef struct {
+	unsigned long iterations;
+	Buffer *buffer;
+	Channel *channel;
+	ReadingIdentifier *ids[3];
+	Reading *reading;
+	std::list<Option> *options;
+	expression_program *programs;
+	size_t expressions;
+} state_t;
+
+typedef struct {
+	const char *name;
+	void (*setup)(state_t *state);
+	void *(*worker)(void *arg);
+	void (*teardown)(state_t *state);
+	void *(*consumer)(void *arg); /**< extra thread, not counted */
+} benchmark_t;
+
+/**
+ * Push readings and clean them up like the logging thread does
+ */
+static void buffer_setup(state_t *state) {
+	state->buffer = new Buffer();
+	state->reading = new Reading(ReadingIdentifier::Ptr(new ObisIdentifier(Obis("1.8.0"))));
+}
+
+static void buffer_teardown(state_t *state) {
+	delete state->buffer;
+	delete state->reading;
+}
+
+static void * buffer_worker(void *arg) {
+	state_t *state = (state_t *) arg;
+	Buffer *buf = state->buffer;
+
+	for (unsigned long i = 1; i <= state->iterations; i++) {
+		buf->push(*state->reading);
+
+		if (i % BENCH_CLEAN == 0) {
+			buf->lock();
+			for (Buffer::iterator it = buf->begin(); it != buf->end(); it++) {
+				it->mark_delete();
+			}
+			buf->unlock();
+			buf->clean();
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Hand readings over from the meter threads to one logging thread
+ */
+static void channel_setup(state_t *state) {
+	std::list<Option> options;
+	ReadingIdentifier::Ptr id(new ObisIdentifier(Obis("1.8.0")));
+
+	state->channel = new Channel(options, "volkszaehler", "00000000-0000-0000-0000-000000000000", id);
+	state->reading = new Reading(id);
+}
+
+static void channel_teardown(state_t *state) {
+	delete state->channel;
+	delete state->reading;
+}
+
+static void * channel_worker(void *arg) {
+	state_t *state = (state_t *) arg;
+
+	for (unsigned long i = 0; i < state->iterations; i++) {
+		state->channel->push(*state->reading);
+		state->channel->notify();
+	}
+
+	return NULL;
+}
+
+static void channel_consume(Buffer::Ptr buf) {
+	buf->lock();
+	for (Buffer::iterator it = buf->begin(); it != buf->end(); it++) {
+		it->mark_delete();
+	}
+	buf->unlock();
+	buf->clean();
+}
+
+static void * channel_consumer(void *arg) {
+	state_t *state = (state_t *) arg;
+
+	do {
+		state->channel->wait();
+		channel_consume(state->channel->buffer());
+	} while (!state->channel->draining());
+
+	return NULL;
+}
+
+/**
+ * Match the identifiers of the readings against the channels
+ */
+static void identifier_setup(state_t *state) {
+	state->ids[0] = new ObisIdentifier(Obis("1.8.0"));
+	state->ids[1] = new ObisIdentifier(Obis("1.8.0"));
+	state->ids[2] = new ObisIdentifier(Obis("2.8.0"));
+}
+
+static void identifier_teardown(state_t *state) {
+	for (int i = 0; i < 3; i++) {
+		delete state->ids[i];
+	}
+}
+
+static void * identifier_worker(void *arg) {
+	state_t *state = (state_t *) arg;
+	ReadingIdentifier *lhs = state->ids[0];
+
+	for (unsigned long i = 0; i < state->iterations; i++) {
+		ReadingIdentifier *rhs = state->ids[1 + (i & 1)]; /* every other one matches */
+		sink = lhs->compare(lhs, rhs);
+	}
+
+	return NULL;
+}
+
+/**
+ * Obis parsing, comparison and alias lookup
+ */
+static void * obis_parse_worker(void *arg) {
+	state_t *state = (state_t *) arg;
+
+	for (unsigned long i = 0; i < state->iterations; i++) {
+		Obis obis("1-0:1.8.0*255");
+		sink = obis.isNull();
+	}
+
+	return NULL;
+}
+
+static void * obis_compare_worker(void *arg) {
+	state_t *state = (state_t *) arg;
+	Obis lhs("1-0:1.8.0*255");
+	const Obis rhs[2] = { Obis("1-0:1.8.0*255"), Obis("1-0:2.8.0*255") };
+
+	for (unsigned long i = 0; i < state->iterations; i++) {
+		sink = (lhs == rhs[i & 1]);
+	}
+
+	return NULL;
+}
+
+static void * obis_alias_worker(void *arg) {
+	state_t *state = (state_t *) arg;
+
+	for (unsigned long i = 0; i < state->iterations; i++) {
+		Obis obis("power-l3"); /* near the end of the alias table */
+		sink = obis.isNull();
+	}
+
+	return NULL;
+}
+
+/**
+ * Copy a reading, as done for every reading pushed to a buffer
+ */
+static void reading_setup(state_t *state) {
+	struct timeval tv = { 1334243590, 250000 };
+	state->reading = new Reading(1213.5, tv, ReadingIdentifier::Ptr(new ObisIdentifier(Obis("1.8.0"))));
+}
+
+static void reading_teardown(state_t *state) {
+	delete state->reading;
+}
+
+static void * reading_worker(void *arg) {
+	state_t *state = (state_t *) arg;
+
+	for (unsigned long i = 0; i < state->iterations; i++) {
+		Reading copy(*state->reading);
+		sink = copy.deleted();
+	}
+
+	return NULL;
+}
+
+/**
+ * Lookup the last option of a typical meter configuration
+ */
+static void options_setup(state_t *state) {
+	state->options = new std::list<Option>();
+	state->options->push_back(Option("enabled", true));
+	state->options->push_back(Option("protocol", (char *) "d0"));
+	state->options->push_back(Option("device", (char *) "/dev/ttyUSB0"));
+	state->options->push_back(Option("baudrate", 9600));
+	state->options->push_back(Option("parity", (char *) "7e1"));
+	state->options->push_back(Option("pullseq", (char *) ""));
+	state->options->push_back(Option("aggtime", -1));
+	state->options->push_back(Option("interval", 30));
+}
+
+static void options_teardown(state_t *state) {
+	delete state->options;
+}
+
+static void * options_worker(void *arg) {
+	state_t *state = (state_t *) arg;
+	OptionList optlist;
+
+	for (unsigned long i = 0; i < state->iterations; i++) {
+		sink = optlist.lookup_int(*state->options, "interval");
+	}
+
+	return NULL;
+}
+
+/**
+ * Recalculate register values with compiled expressions
+ * and the way it was done before, printing and parsing every value
+ */
+static void expression_setup(state_t *state) {
+	const char *error;
+
+	for (state->expressions = 0; expressions[state->expressions]; state->expressions++);
+	state->programs = new expression_program[state->expressions];
+
+	for (size_t i = 0; i < state->expressions; i++) {
+		if (expression_compile(expressions[i], &state->programs[i], &error) != 0) {
+			throw vz::VZException(error);
+		}
+	}
+}
+
+static void expression_teardown(state_t *state) {
+	delete[] state->programs;
+}
+
+static void * expression_worker(void *arg) {
+	state_t *state = (state_t *) arg;
+
+	for (unsigned long i = 0; i < state->iterations; i++) {
+		sink = (int) expression_evaluate(&state->programs[i % state->expressions], i & 0xffff);
+	}
+
+	return NULL;
+}
+
+static void * expression_parse_worker(void *arg) {
+	state_t *state = (state_t *) arg;
+
+	for (unsigned long i = 0; i < state->iterations; i++) {
+		char *expression;
+		if (asprintf(&expression, expressions[i % state->expressions], (unsigned) (i & 0xffff)) < 0) break;
+		sink = (int) parse_expression(expression);
+		free(expression);
+	}
+
+	return NULL;
+}
+
+static const benchmark_t benchmarks[] = {
+	{ "buffer",     buffer_setup,     buffer_worker,       buffer_teardown,     NULL },
+	{ "channel",    channel_setup,    channel_worker,      channel_teardown,    channel_consumer },
+	{ "identifier", identifier_setup, identifier_worker,   identifier_teardown, NULL },
+	{ "obis-parse", NULL,             obis_parse_worker,   NULL,                NULL },
+	{ "obis-cmp",   NULL,             obis_compare_worker, NULL,                NULL },
+	{ "obis-alias", NULL,             obis_alias_worker,   NULL,                NULL },
+	{ "reading",    reading_setup,    reading_worker,      reading_teardown,    NULL },
+	{ "options",    options_setup,    options_worker,      options_teardown,    NULL },
+	{ "expr-eval",  expression_setup, expression_worker,   expression_teardown, NULL },
+	{ "expr-parse", expression_setup, expression_parse_worker, expression_teardown, NULL },
+	{ NULL }
+};
+
+static void run(const benchmark_t *benchmark, unsigned int threads, unsigned long iterations) {
+	state_t state;
+	pthread_t *workers = new pthread_t[threads];
+	pthread_t consumer;
+
+	memset(&state, 0, sizeof(state));
+	state.iterations = iterations;
+	if (benchmark->setup) {
+		benchmark->setup(&state);
+	}
+
+	if (benchmark->consumer) {
+		pthread_create(&consumer, NULL, benchmark->consumer, &state);
+	}
+
+	unsigned long long allocations = bench::allocations();
+	double start = bench::now();
+
+	for (unsigned int i = 0; i < threads; i++) {
+		pthread_create(&workers[i], NULL, benchmark->worker, &state);
+	}
+	for (unsigned int i = 0; i < threads; i++) {
+		pthread_join(workers[i], NULL);
+	}
+
+	if (benchmark->consumer) {
+		state.channel->drain();
+		pthread_join(consumer, NULL);
+		channel_consume(state.channel->buffer()); /* whatever was pushed after the last wakeup */
+	}
+
+	double elapsed = bench::now() - start;
+	allocations = bench::allocations() - allocations;
+	double ops = (double) iterations * threads;
+
+	printf("%-12s %8u %12.1f %12.2f %10.2f\n", benchmark->name, threads,
+		elapsed * 1e9 / iterations, ops / elapsed / 1e6, allocations / ops);
+
+	if (benchmark->teardown) {
+		benchmark->teardown(&state);
+	}
+	delete[] workers;
+}
+
+static void usage(const char *program) {
+	fprintf(stderr, "usage: %s [-n iterations] [-t threads] [benchmark]...\n", program);
+	fprintf(stderr, "  -n iterations  operations per thread (default %d)\n", BENCH_ITERATIONS);
+	fprintf(stderr, "  -t threads     largest number of threads (default: number of cpus, at least 4)\n");
+	fprintf(stderr, "benchmarks:");
+	for (const benchmark_t *b = benchmarks; b->name; b++) {
+		fprintf(stderr, " %s", b->name);
+	}
+	fprintf(stderr, " (all by default)\n");
+}
+
+int main(int argc, char *argv[]) {
+	unsigned long iterations = BENCH_ITERATIONS;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int max = (cpus > 4) ? cpus : 4;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:t:h")) != -1) {
+		switch (c) {
+			case 'n':
+				iterations = strtoul(optarg, NULL, 10);
+				break;
+			case 't':
+				max = strtoul(optarg, NULL, 10);
+				break;
+			default:
+				usage(argv[0]);
+				return (c == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (iterations == 0 || max == 0) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	/* 1, 2 and N threads */
+	unsigned int threads[3] = { 1, 2, max };
+	unsigned int runs = (max > 2) ? 3 : max;
+
+	printf("%-12s %8s %12s %12s %10s\n", "benchmark", "threads", "ns/op", "Mops/s", "allocs/op");
+
+	try {
+		for (const benchmark_t *b = benchmarks; b->name; b++) {
+			bool selected = (optind == argc);
+
+			for (int i = optind; i < argc; i++) {
+				if (strcmp(argv[i], b->name) == 0) {
+					selected = true;
+				}
+			}
+
+			for (unsigned int i = 0; selected && i < runs; i++) {
+				run(b, threads[i], iterations);
+			}
+		}
+	} catch (vz::VZException &e) {
+		fprintf(stderr, "%s\n", e.what());
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,510 @@
+/**
+ * Throughput benchmark of the meter protocols
+ *
+ * A recorded byte stream is written as fast as possible into a pty (d0, sml)
+ * or a fifo (fluksov2, file), while the protocol parses it on the other end
+ * just like it does in the daemon. Built-in recordings are used unless a file
+ * is given, e.g. "bench_protocols d0=ehz.log".
+ * The SML decoders are additionally timed in memory, without the transport:
+ * "sml-decoder" is the in-tree SmlDecoder, "sml-libsml" parses with libsml.
+ *
+ * @package vzlogger
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @license http://www.gnu.org/licenses/gpl.txt GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <pty.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+#include <list>
+
+#include "bench.hpp"
+#include <Options.hpp>
+#include <VZException.hpp>
+#include <protocols/MeterD0.hpp>
+#include <protocols/MeterFile.hpp>
+#include <protocols/MeterFluksoV2.hpp>
+
+#ifdef SML_SUPPORT
+#include <sml/sml_file.h>
+#include <sml/sml_value.h>
+#include <protocols/MeterSML.hpp>
+#include <protocols/SmlDecoder.hpp>
+#endif
+
+#define BENCH_REPEAT 10000 /* default number of times the recording is written */
+
+/* eHZ style telegram */
+static const char d0_recording[] =
+	"/ESY5Q3DA1004 V3.02\r\n"
+	"\r\n"
+	"1-0:0.0.0*255(0272031312565)\r\n"
+	"1-0:1.8.0*255(00000001.5423*kWh)\r\n"
+	"1-0:21.7.255*255(000071.36*W)\r\n"
+	"1-0:41.7.255*255(000027.50*W)\r\n"
+	"1-0:61.7.255*255(000014.53*W)\r\n"
+	"1-0:1.7.255*255(000113.39*W)\r\n"
+	"1-0:96.5.5*255(82)\r\n"
+	"0-0:96.1.255*255(1ESY1011003144)\r\n"
+	"!\r\n";
+
+/* SML file with open, get list (5 values) and close response */
+static const unsigned char sml_recording[] = {
+	0x1b, 0x1b, 0x1b, 0x1b, 0x01, 0x01, 0x01, 0x01, 0x76, 0x02, 0x01, 0x62,
+	0x00, 0x62, 0x00, 0x72, 0x63, 0x01, 0x01, 0x76, 0x01, 0x01, 0x04, 0x01,
+	0x02, 0x03, 0x0b, 0x0a, 0x01, 0x45, 0x4d, 0x48, 0x00, 0x00, 0x75, 0xb7,
+	0xc8, 0x01, 0x01, 0x63, 0x58, 0x29, 0x00, 0x76, 0x02, 0x02, 0x62, 0x00,
+	0x62, 0x00, 0x72, 0x63, 0x07, 0x01, 0x77, 0x01, 0x0b, 0x0a, 0x01, 0x45,
+	0x4d, 0x48, 0x00, 0x00, 0x75, 0xb7, 0xc8, 0x01, 0x01, 0x77, 0x77, 0x07,
+	0x81, 0x81, 0xc7, 0x82, 0x03, 0xff, 0x01, 0x01, 0x01, 0x01, 0x04, 0x45,
+	0x4d, 0x48, 0x01, 0x77, 0x07, 0x01, 0x00, 0x00, 0x00, 0x09, 0xff, 0x01,
+	0x01, 0x01, 0x01, 0x0b, 0x0a, 0x01, 0x45, 0x4d, 0x48, 0x00, 0x00, 0x75,
+	0xb7, 0xc8, 0x01, 0x77, 0x07, 0x01, 0x00, 0x01, 0x08, 0x00, 0xff, 0x64,
+	0x1c, 0x01, 0x04, 0x01, 0x62, 0x1e, 0x52, 0xff, 0x69, 0x00, 0x00, 0x00,
+	0x00, 0x07, 0x5b, 0xcd, 0x15, 0x01, 0x77, 0x07, 0x01, 0x00, 0x01, 0x08,
+	0x01, 0xff, 0x01, 0x01, 0x62, 0x1e, 0x52, 0xff, 0x69, 0x00, 0x00, 0x00,
+	0x00, 0x06, 0x2a, 0xa0, 0x15, 0x01, 0x77, 0x07, 0x01, 0x00, 0x02, 0x08,
+	0x00, 0xff, 0x01, 0x01, 0x62, 0x1e, 0x52, 0xff, 0x69, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x11, 0xd7, 0x01, 0x77, 0x07, 0x01, 0x00, 0x10, 0x07,
+	0x00, 0xff, 0x01, 0x01, 0x62, 0x1b, 0x52, 0xff, 0x55, 0xff, 0xff, 0xeb,
+	0x37, 0x01, 0x77, 0x07, 0x01, 0x00, 0x24, 0x07, 0x00, 0xff, 0x01, 0x01,
+	0x62, 0x1b, 0x52, 0xff, 0x55, 0x00, 0x00, 0x04, 0xd2, 0x01, 0x01, 0x01,
+	0x63, 0x25, 0xba, 0x00, 0x76, 0x02, 0x03, 0x62, 0x00, 0x62, 0x00, 0x72,
+	0x63, 0x02, 0x01, 0x71, 0x01, 0x63, 0xd5, 0x35, 0x00, 0x00, 0x00, 0x00,
+	0x1b, 0x1b, 0x1b, 0x1b, 0x1a, 0x03, 0xc0, 0x31
+};
+
+/* timestamp followed by channel, consumption and power triples */
+static const char fluksov2_recording[] =
+	"1334243590 0 41231 1213 1 8453 120 2 0 0\n"
+	"1334243591 0 41232 1215 1 8453 118 2 0 0\n"
+	"1334243592 0 41232 1210 1 8453 121 2 0 0\n"
+	"1334243593 0 41232 1212 1 8454 119 2 0 0\n";
+
+/* log lines as written by other tools, parsed with "$t $i $v" */
+static const char file_recording[] =
+	"1334243590.250 power 1213.5\n"
+	"1334243590.250 voltage 230.1\n"
+	"1334243591.250 power 1215.0\n"
+	"1334243591.250 voltage 229.8\n";
+
+typedef struct {
+	const char *name;
+	bool pty;                  /**< feed through a pty, a fifo otherwise */
+	size_t max_readings;       /**< same as in the meter details */
+	const char *recording;
+	size_t len;
+} protocol_t;
+
+static const protocol_t protocols[] = {
+	{ "d0",       true,  32, d0_recording,              sizeof(d0_recording) - 1 },
+#ifdef SML_SUPPORT
+	{ "sml",      true,  32, (const char *) sml_recording, sizeof(sml_recording) },
+#endif
+	{ "fluksov2", false, 16, fluksov2_recording,        sizeof(fluksov2_recording) - 1 },
+	{ "file",     false, 32, file_recording,            sizeof(file_recording) - 1 },
+	{ NULL }
+};
+
+#ifdef SML_SUPPORT
+typedef size_t (*decode_t)(unsigned char *file, size_t len, std::vector<Reading> &rds);
+
+static size_t decode_sml(unsigned char *file, size_t len, std::vector<Reading> &rds) {
+	static SmlDecoder decoder; /* keeps its interned identifiers like the meter does */
+
+	return decoder.decode(file, len, rds, rds.size());
+}
+
+/**
+ * Evaluate the file like MeterSML did with libsml before the in-tree decoder
+ */
+static size_t decode_libsml(unsigned char *file, size_t len, std::vector<Reading> &rds) {
+	sml_file *parsed = sml_file_parse(file, len);
+	size_t m = 0;
+
+	for (short i = 0; i < parsed->messages_len; i++) {
+		sml_message *message = parsed->messages[i];
+
+		if (*message->message_body->tag != SML_MESSAGE_GET_LIST_RESPONSE) continue;
+
+		sml_get_list_response *body = (sml_get_list_response *) message->message_body->data;
+		for (sml_list *entry = body->val_list; entry != NULL && m < rds.size(); entry = entry->next, m++) {
+			int scaler = (entry->scaler) ? *entry->scaler : 0;
+			rds[m].value(sml_value_to_double(entry->value) * pow(10, scaler));
+
+			const unsigned char *obis = entry->obj_name->str;
+			rds[m].identifier(new ObisIdentifier(Obis(obis[0], obis[1], obis[2], obis[3], obis[4], obis[5])));
+			rds[m].time();
+		}
+	}
+
+	sml_file_free(parsed);
+	return m;
+}
+
+typedef struct {
+	const char *name;
+	decode_t decode;
+} decoder_t;
+
+static const decoder_t decoders[] = {
+	{ "sml-decoder", decode_sml },
+	{ "sml-libsml",  decode_libsml },
+	{ NULL }
+};
+#endif /* SML_SUPPORT */
+
+typedef struct {
+	std::string recording;
+	unsigned long repeat;
+	const char *fifo;          /**< opened by the feeder, NULL for a pty */
+	int fd;                    /**< write end */
+	int drain;                 /**< slave of the pty, to wait until the protocol has read everything */
+	volatile bool done;        /**< the write end has been closed */
+} feed_t;
+
+/**
+ * Write the recording repeatedly, then hang up
+ */
+static void * feeder(void *arg) {
+	feed_t *feed = (feed_t *) arg;
+
+	if (feed->fifo) {
+		feed->fd = open(feed->fifo, O_WRONLY); /* blocks until the protocol opens the fifo */
+		if (feed->fd < 0) {
+			print(log_error, "open(%s): %s", "bench", feed->fifo, strerror(errno));
+			feed->done = true;
+			return NULL;
+		}
+	}
+
+	for (unsigned long i = 0; i < feed->repeat; i++) {
+		const char *p = feed->recording.data();
+		size_t left = feed->recording.size();
+
+		while (left > 0) {
+			ssize_t written = write(feed->fd, p, left);
+			if (written < 0) {
+				if (errno == EINTR) continue;
+				print(log_error, "write(): %s", "bench", strerror(errno));
+				i = feed->repeat;
+				break;
+			}
+			p += written;
+			left -= written;
+		}
+	}
+
+	/* a pty discards unread input on hangup */
+	int queued;
+	while (feed->drain >= 0 && ioctl(feed->drain, FIONREAD, &queued) == 0 && queued > 0) {
+		usleep(1000);
+	}
+
+	close(feed->fd);
+	feed->done = true;
+	return NULL;
+}
+
+static vz::protocol::Protocol * create(const char *name, const char *path) {
+	std::list<Option> options;
+
+	if (strcmp(name, "d0") == 0) {
+		options.push_back(Option("device", (char *) path));
+		return new MeterD0(options);
+	}
+#ifdef SML_SUPPORT
+	else if (strcmp(name, "sml") == 0) {
+		options.push_back(Option("device", (char *) path));
+		return new MeterSML(options);
+	}
+#endif
+	else if (strcmp(name, "fluksov2") == 0) {
+		options.push_back(Option("fifo", (char *) path));
+		return new MeterFluksoV2(options);
+	}
+	else {
+		options.push_back(Option("path", (char *) path));
+		options.push_back(Option("format", (char *) "$t $i $v"));
+		return new MeterFile(options);
+	}
+}
+
+static int run(const protocol_t *protocol, const std::string &recording, unsigned long repeat) {
+	char path[PATH_MAX];
+	char dir[] = "/tmp/vzbench.XXXXXX";
+	int slave = -1;
+	pthread_t thread;
+	feed_t feed;
+
+	feed.recording = recording;
+	feed.repeat = repeat;
+	feed.fifo = NULL;
+	feed.fd = -1;
+	feed.drain = -1;
+	feed.done = false;
+
+	if (protocol->pty) {
+		struct termios tio;
+
+		if (openpty(&feed.fd, &slave, path, NULL, NULL) < 0) {
+			print(log_error, "openpty(): %s", protocol->name, strerror(errno));
+			return ERR;
+		}
+		/* nothing must be echoed or translated until the protocol has configured the port */
+		tcgetattr(slave, &tio);
+		cfmakeraw(&tio);
+		tcsetattr(slave, TCSANOW, &tio);
+		feed.drain = slave;
+	}
+	else {
+		if (mkdtemp(dir) == NULL) {
+			print(log_error, "mkdtemp(): %s", protocol->name, strerror(errno));
+			return ERR;
+		}
+		snprintf(path, sizeof(path), "%s/%s", dir, protocol->name);
+		if (mkfifo(path, 0600) < 0) {
+			print(log_error, "mkfifo(%s): %s", protocol->name, path, strerror(errno));
+			rmdir(dir);
+			return ERR;
+		}
+		feed.fifo = path;
+	}
+
+	std::vector<Reading> rds(protocol->max_readings);
+	vz::protocol::Protocol *proto = create(protocol->name, path);
+	proto->deadline(5); /* do not hang if the feeder fails */
+
+	pthread_create(&thread, NULL, &feeder, &feed);
+
+	if (proto->open() < 0) {
+		pthread_cancel(thread);
+	}
+	else {
+		unsigned long long readings = 0;
+		unsigned long long allocations = bench::allocations();
+		double start = bench::now();
+
+		while (true) {
+			ssize_t n = proto->read(rds, rds.size());
+			if (n > 0) {
+				readings += n;
+			}
+			else if (!proto->connected() || (n == 0 && feed.done)) {
+				break; /* the feeder has hung up */
+			}
+		}
+
+		double elapsed = bench::now() - start;
+		allocations = bench::allocations() - allocations;
+		const vz::protocol::Protocol::stats_t &stats = proto->stats();
+
+		printf("%-12s %10llu %8llu %12.1f %8.2f %12.1f %10.2f\n", protocol->name,
+			stats.telegrams, stats.errors, stats.telegrams / elapsed, stats.bytes / elapsed / 1e6,
+			readings / elapsed, stats.telegrams ? (double) allocations / stats.telegrams : 0.0);
+
+		proto->close();
+	}
+
+	pthread_join(thread, NULL);
+	delete proto;
+
+	if (protocol->pty) {
+		close(slave);
+	}
+	else {
+		unlink(path);
+		rmdir(dir);
+	}
+
+	return SUCCESS;
+}
+
+#ifdef SML_SUPPORT
+/**
+ * Decode all SML files of the recording repeatedly in memory
+ */
+static int decode(const decoder_t *decoder, const std::string &recording, unsigned long repeat) {
+	static const char start_seq[] = "\x1b\x1b\x1b\x1b\x01\x01\x01\x01";
+	static const char end_seq[] = "\x1b\x1b\x1b\x1b\x1a";
+	std::vector<std::vector<unsigned char> > files;
+
+	/* strip the escape sequences like sml_transport_read() and MeterSML::read() do */
+	size_t start = 0;
+	while ((start = recording.find(start_seq, start, 8)) != std::string::npos) {
+		size_t end = recording.find(end_seq, start + 8, 5);
+		if (end == std::string::npos) break;
+
+		files.push_back(std::vector<unsigned char>(recording.begin() + start + 8, recording.begin() + end));
+		start = end + 8;
+	}
+
+	if (files.empty()) {
+		print(log_error, "No SML file in the recording", decoder->name);
+		return ERR;
+	}
+
+	std::vector<Reading> rds(32);
+	unsigned long long readings = 0, bytes = 0, empty = 0;
+	unsigned long long allocations = bench::allocations();
+	double begin = bench::now();
+
+	for (unsigned long i = 0; i < repeat; i++) {
+		for (size_t f = 0; f < files.size(); f++) {
+			size_t n = decoder->decode(&files[f][0], files[f].size(), rds);
+			if (n == 0) empty++; /* counted as errors */
+			readings += n;
+			bytes += files[f].size() + 16;
+		}
+	}
+
+	double elapsed = bench::now() - begin;
+	allocations = bench::allocations() - allocations;
+	unsigned long long telegrams = (unsigned long long) repeat * files.size();
+
+	printf("%-12s %10llu %8llu %12.1f %8.2f %12.1f %10.2f\n", decoder->name,
+		telegrams, empty, telegrams / elapsed, bytes / elapsed / 1e6,
+		readings / elapsed, telegrams ? (double) allocations / telegrams : 0.0);
+
+	return SUCCESS;
+}
+#endif /* SML_SUPPORT */
+
+static bool load(const char *file, std::string &recording) {
+	FILE *fp = fopen(file, "rb");
+	char buffer[4096];
+	size_t len;
+
+	if (fp == NULL) {
+		print(log_error, "fopen(%s): %s", "bench", file, strerror(errno));
+		return false;
+	}
+
+	recording.clear();
+	while ((len = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+		recording.append(buffer, len);
+	}
+	fclose(fp);
+
+	return !recording.empty();
+}
+
+static void usage(const char *program) {
+	fprintf(stderr, "usage: %s [-n repeat] [-v] [protocol[=recording]]...\n", program);
+	fprintf(stderr, "  -n repeat   write the recording this many times (default %d)\n", BENCH_REPEAT);
+	fprintf(stderr, "  -v          print the log messages of the protocols\n");
+	fprintf(stderr, "protocols:");
+	for (const protocol_t *p = protocols; p->name; p++) {
+		fprintf(stderr, " %s", p->name);
+	}
+#ifdef SML_SUPPORT
+	for (const decoder_t *d = decoders; d->name; d++) {
+		fprintf(stderr, " %s", d->name);
+	}
+#endif
+	fprintf(stderr, " (all by default)\n");
+}
+
+/**
+ * Check whether a protocol has been selected on the command line and load its recording
+ *
+ * @return false if the recording could not be loaded
+ */
+static bool wanted(const char *name, int argc, char *argv[], std::string &recording, bool &selected) {
+	selected = (optind == argc);
+
+	for (int i = optind; i < argc; i++) {
+		size_t len = strcspn(argv[i], "=");
+		if (strlen(name) == len && strncmp(argv[i], name, len) == 0) {
+			selected = true;
+			if (argv[i][len] == '=' && !load(argv[i] + len + 1, recording)) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	unsigned long repeat = BENCH_REPEAT;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:vh")) != -1) {
+		switch (c) {
+			case 'n':
+				repeat = strtoul(optarg, NULL, 10);
+				break;
+			case 'v':
+				bench::verbosity = log_debug;
+				break;
+			default:
+				usage(argv[0]);
+				return (c == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	printf("%-12s %10s %8s %12s %8s %12s %10s\n", "protocol",
+		"telegrams", "errors", "telegrams/s", "MB/s", "readings/s", "allocs/tg");
+
+	try {
+		for (const protocol_t *p = protocols; p->name; p++) {
+			std::string recording(p->recording, p->len);
+			bool selected;
+
+			if (!wanted(p->name, argc, argv, recording, selected)) {
+				return EXIT_FAILURE;
+			}
+			if (selected && run(p, recording, repeat) != SUCCESS) {
+				return EXIT_FAILURE;
+			}
+		}
+#ifdef SML_SUPPORT
+		for (const decoder_t *d = decoders; d->name; d++) {
+			std::string recording((const char *) sml_recording, sizeof(sml_recording));
+			bool selected;
+
+			if (!wanted(d->name, argc, argv, recording, selected)) {
+				return EXIT_FAILURE;
+			}
+			if (selected && decode(d, recording, repeat) != SUCCESS) {
+				return EXIT_FAILURE;
+			}
+		}
+#endif
+	} catch (vz::VZException &e) {
+		fprintf(stderr, "%s\n", e.what());
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,326 @@
+#!/usr/bin/env python3
+#
+# Load test of vzlogger against the mock middleware
+#
+# Generates a configuration with N random meters of M channels each,
+# runs vzlogger against mock_middleware.py and reports the delivered
+# readings/s, the reading to middleware latency and vzlogger's CPU and RSS.
+#
+# With --modbus the meters poll M registers each from modbus_sim instead,
+# with and without coalescing and pipelining, and the requests/poll, bytes
+# on the wire and poll latency reported by the modbus meters are compared.
+#
+# @package vzlogger
+# @copyright Copyright (c) 2011, The volkszaehler.org project
+# @license http://www.gnu.org/licenses/gpl.txt GNU Public License
+#
+# This file is part of volkzaehler.org
+#
+# volkzaehler.org is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# any later version.
+#
+# volkzaehler.org is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+
+import argparse
+import json
+import os
+import re
+import shutil
+import signal
+import subprocess
+import sys
+import tempfile
+import threading
+import socket
+import time
+import uuid
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import mock_middleware
+
+
+def config(args, url, log):
+	meters = []
+	for m in range(args.meters):
+		channels = []
+		for c in range(args.channels):
+			channels.append({
+				'uuid': str(uuid.UUID(int=(m << 32) | c)),
+				'middleware': url,
+				'identifier': 'test' if args.channels == 1 else 'test%d' % c,
+			})
+		meters.append({
+			'enabled': True,
+			'protocol': 'random',
+			'rate': args.rate,
+			'min': 0.0,
+			'max': 100.0,
+			'identifiers': args.channels,
+			'seed': m,
+			'channels': channels,
+		})
+
+	return {
+		'retry': 1,
+		'shutdown': 5,
+		'daemon': True,
+		'foreground': True,
+		'verbosity': args.verbosity,
+		'log': log,
+		'local': {'enabled': False},
+		'meters': meters,
+	}
+
+
+def modbus_config(args, url, log, port, max_gap, pipeline):
+	"""every meter is a slave behind the same gateway, its registers are one address apart"""
+	meters = []
+	for m in range(args.meters):
+		slave = m + 1
+		addresses = [40001 + 2 * c for c in range(args.channels)]
+		meters.append({
+			'enabled': True,
+			'protocol': 'modbus',
+			'interval': args.interval,
+			'ip': '127.0.0.1',
+			'port': port,
+			'pipeline': pipeline,
+			'max_gap': max_gap,
+			'statistics': 1,
+			'addresses': [[3, address, '%u', slave] for address in addresses],
+			'channels': [{
+				'uuid': str(uuid.UUID(int=(m << 32) | c)),
+				'middleware': url,
+				'identifier': 'slave%d/address%d' % (slave, address),
+			} for c, address in enumerate(addresses)],
+		})
+
+	return {
+		'retry': 1,
+		'shutdown': 5,
+		'daemon': True,
+		'foreground': True,
+		'verbosity': max(args.verbosity, 5),	# the statistics are logged as info
+		'log': log,
+		'local': {'enabled': False},
+		'meters': meters,
+	}
+
+
+POLLS = re.compile(r'Statistics: (\d+) polls, ([\d.]+) requests/poll, (\d+)/(\d+) bytes/poll sent/received')
+LATENCY = re.compile(r'Statistics: poll latency ([\d.]+) ms avg, ([\d.]+) ms max, ([\d.]+) ms avg queued')
+
+
+def modbus_stats(log):
+	"""
+	sums up the statistics reports of all modbus meters in the log
+
+	All meters log as [modbus], so the latency reports are averaged without
+	weighting them by the polls they cover, every meter polls equally often.
+	"""
+	stats = {'polls': 0, 'requests/poll': 0.0, 'tx/poll': 0.0, 'rx/poll': 0.0, 'latency': 0.0, 'max': 0.0, 'queued': 0.0}
+	reports = 0
+	for line in log.splitlines():
+		match = POLLS.search(line)
+		if match:
+			polls = int(match.group(1))
+			stats['polls'] += polls
+			stats['requests/poll'] += polls * float(match.group(2))
+			stats['tx/poll'] += polls * int(match.group(3))
+			stats['rx/poll'] += polls * int(match.group(4))
+			continue
+
+		match = LATENCY.search(line)
+		if match:
+			reports += 1
+			stats['latency'] += float(match.group(1))
+			stats['max'] = max(stats['max'], float(match.group(2)))
+			stats['queued'] += float(match.group(3))
+
+	for key in ('requests/poll', 'tx/poll', 'rx/poll'):
+		stats[key] /= max(stats['polls'], 1)
+	for key in ('latency', 'queued'):
+		stats[key] /= max(reports, 1)
+	return stats
+
+
+def start_simulator(args):
+	"""starts modbus_sim on a free port with a slave per meter"""
+	with socket.socket() as s:
+		s.bind(('127.0.0.1', 0))
+		port = s.getsockname()[1]
+
+	sim = subprocess.Popen([args.modbus, '-a', '127.0.0.1', '-p', str(port), '-u', str(args.meters),
+		'-r', str(2 * args.channels), '-l', str(args.modbus_latency)], stdout=subprocess.PIPE, universal_newlines=True)
+	if not sim.stdout.readline().startswith('listening'):	# ready to accept connections
+		sim.wait()
+		raise RuntimeError('modbus_sim terminated with %d' % sim.returncode)
+	return sim, port
+
+
+class Sampler(threading.Thread):
+	"""samples the cpu time and resident set of a process once a second"""
+
+	def __init__(self, pid):
+		threading.Thread.__init__(self, daemon=True)
+		self.pid = pid
+		self.ticks = os.sysconf('SC_CLK_TCK')
+		self.rss = 0
+		self.running = True
+		self.reset()
+
+	def cpu(self):
+		with open('/proc/%d/stat' % self.pid) as f:
+			fields = f.read().rsplit(')', 1)[1].split()
+		return (int(fields[11]) + int(fields[12])) / float(self.ticks)	# utime + stime
+
+	def reset(self):
+		self.since = time.time()
+		self.cpu_since = self.cpu()
+		self.rss_max = 0
+
+	def run(self):
+		while self.running:
+			try:
+				with open('/proc/%d/status' % self.pid) as f:
+					for line in f:
+						if line.startswith('VmRSS:'):
+							self.rss = int(line.split()[1])	# kB
+							self.rss_max = max(self.rss_max, self.rss)
+			except IOError:
+				break
+			time.sleep(1)
+
+	def usage(self):
+		"""cpu usage in % of one core since the last reset()"""
+		return 100.0 * (self.cpu() - self.cpu_since) / (time.time() - self.since)
+
+
+def run(args, server, tmp, name, cfg):
+	"""
+	runs vzlogger with the configuration through the warmup and the measured time
+
+	@return middleware statistics, cpu usage, the sampler and the log written while measuring
+	"""
+	conf = os.path.join(tmp, name + '.conf')
+	with open(conf, 'w') as f:
+		json.dump(cfg, f, indent='\t')
+
+	proc = subprocess.Popen([args.vzlogger, '-c', conf], stdout=subprocess.DEVNULL if args.modbus else None)
+	sampler = Sampler(proc.pid)
+	sampler.start()
+	try:
+		time.sleep(args.warmup)
+		if proc.poll() is not None:
+			raise RuntimeError('vzlogger terminated with %d, see %s' % (proc.returncode, tmp))
+		server.reset()
+		sampler.reset()
+		offset = os.path.getsize(cfg['log']) if os.path.exists(cfg['log']) else 0
+
+		time.sleep(args.duration)
+		if proc.poll() is not None:
+			raise RuntimeError('vzlogger terminated with %d, see %s' % (proc.returncode, tmp))
+		stats = server.stats()
+		cpu = sampler.usage()
+	finally:
+		if proc.poll() is None:
+			proc.send_signal(signal.SIGTERM)
+			try:
+				proc.wait(timeout=15)
+			except subprocess.TimeoutExpired:
+				proc.kill()
+				proc.wait()
+		sampler.running = False
+
+	log = ''
+	if os.path.exists(cfg['log']):
+		with open(cfg['log']) as f:
+			f.seek(offset)
+			log = f.read()
+	return stats, cpu, sampler, log
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Load test of vzlogger against a mock middleware')
+	parser.add_argument('--vzlogger', default='./vzlogger', help='binary to test (default: %(default)s)')
+	parser.add_argument('--meters', type=int, default=10, metavar='N')
+	parser.add_argument('--channels', type=int, default=4, metavar='M', help='channels per meter')
+	parser.add_argument('--rate', type=float, default=10, help='readings/s per meter')
+	parser.add_argument('--duration', type=float, default=30, metavar='SECONDS', help='measured time')
+	parser.add_argument('--warmup', type=float, default=5, metavar='SECONDS', help='time before measuring')
+	parser.add_argument('--verbosity', type=int, default=1, help='of vzlogger')
+	parser.add_argument('--keep', action='store_true', help='keep the configuration and log')
+	modbus = parser.add_argument_group('modbus', 'poll modbus_sim instead of generating random readings')
+	modbus.add_argument('--modbus', metavar='MODBUS_SIM', help='simulator binary, enables the modbus mode')
+	modbus.add_argument('--interval', type=float, default=1, metavar='SECONDS', help='of the modbus meters')
+	modbus.add_argument('--pipeline', type=int, default=4, metavar='DEPTH', help='compared to no pipelining')
+	modbus.add_argument('--modbus-latency', type=float, default=0, metavar='MS', help='of every modbus response')
+	mock_middleware.add_arguments(parser)
+	args = parser.parse_args()
+
+	if args.meters < 1 or args.channels < 1 or args.rate <= 0:
+		parser.error('meters, channels and rate have to be positive')
+	if args.modbus and (args.meters > 247 or args.channels > 60 or args.interval <= 0 or args.pipeline < 2):
+		parser.error('modbus needs at most 247 meters, 60 channels, a positive interval and a pipeline depth of 2 or more')
+
+	tmp = tempfile.mkdtemp(prefix='vzloadtest.')
+	server = mock_middleware.Middleware(('127.0.0.1', 0), args.latency, args.jitter, args.errors, args.outage)
+	threading.Thread(target=server.serve_forever, daemon=True).start()
+
+	sim = None
+	results = []
+	try:
+		if args.modbus:
+			sim, port = start_simulator(args)
+
+			# registers are one address apart, a gap of one merges them into one request
+			for max_gap, pipeline in ((0, 1), (1, 1), (0, args.pipeline), (1, args.pipeline)):
+				name = 'modbus-gap%d-pipeline%d' % (max_gap, pipeline)
+				cfg = modbus_config(args, server.url(), os.path.join(tmp, name + '.log'), port, max_gap, pipeline)
+				stats, cpu, sampler, log = run(args, server, tmp, name, cfg)
+				results.append((max_gap > 0, pipeline, stats, cpu, modbus_stats(log)))
+		else:
+			cfg = config(args, server.url(), os.path.join(tmp, 'vzlogger.log'))
+			stats, cpu, sampler, log = run(args, server, tmp, 'vzlogger', cfg)
+	except Exception as e:
+		print(e, file=sys.stderr)
+		args.keep = True
+		return 1
+	finally:
+		if sim:
+			sim.terminate()
+			sim.wait()
+		server.shutdown()
+		if args.keep:
+			print('configuration and log kept in %s' % tmp, file=sys.stderr)
+		else:
+			shutil.rmtree(tmp)
+
+	if args.modbus:
+		print('%d modbus meters x %d registers every %.1f s, %.1f ms latency of modbus_sim' % (
+			args.meters, args.channels, args.interval, args.modbus_latency))
+		print('%-10s %8s %8s %13s %13s %16s %10s %10s %8s' % ('coalescing', 'pipeline', 'polls', 'requests/poll',
+			'bytes/poll', 'latency avg/max', 'queued', 'readings/s', 'cpu'))
+		for coalescing, pipeline, stats, cpu, modbus in results:
+			print('%-10s %8d %8d %13.1f %6.0f/%-6.0f %7.1f/%-8.1f %10.1f %10.1f %7.1f%%' % ('yes' if coalescing else 'no',
+				pipeline, modbus['polls'], modbus['requests/poll'], modbus['tx/poll'], modbus['rx/poll'],
+				modbus['latency'], modbus['max'], modbus['queued'], stats['readings/s'], cpu))
+		return 0
+
+	print('%d meters x %d channels at %.1f readings/s per meter (%.1f readings/s offered)' % (
+		args.meters, args.channels, args.rate, args.meters * args.rate))
+	print(mock_middleware.format_stats(stats))
+	print('vzlogger: cpu %.1f %%, rss %.1f MB (max %.1f MB)' % (cpu, sampler.rss / 1024.0, sampler.rss_max / 1024.0))
+	return 0
+
+
+if __name__ == '__main__':
+	sys.exit(main())
@@ -0,0 +1,612 @@
+/**
+ * Simulator of serial meters on pseudo terminals
+ *
+ * Every simulated meter gets its own pty whose slave can be used as
+ * "device" in the configuration of vzlogger. Telegrams are written at the
+ * speed of the configured baudrate, with jitter and injected errors.
+ * Outages close the ptys and recreate them, the symlinks keep their names.
+ *
+ * @package vzlogger
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @license http://www.gnu.org/licenses/gpl.txt GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <math.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <time.h>
+#include <termios.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#define SIM_BAUDRATE 9600     /* default speed of the simulated lines */
+#define SIM_BITS 10           /* start + 8 data + stop bit, 7e1 has 10 bits as well */
+#define SIM_INTERVAL 1.0      /* seconds between two telegrams */
+#define SIM_POWER 1000.0      /* average power of the simulated consumers in W */
+#define SIM_RESOLUTION 1000   /* S0 pulses per kWh */
+#define SIM_BOUNCE 0.005      /* an injected S0 bounce follows the pulse after 5 ms */
+
+typedef enum {
+	sim_d0,
+	sim_sml,
+	sim_s0
+} sim_protocol_t;
+
+static const char *protocol_names[] = { "d0", "sml", "s0" };
+
+typedef struct {
+	sim_protocol_t protocol;
+	int index;
+	int master;
+	int slave;                 /**< kept open, the line settings are lost otherwise */
+	char device[PATH_MAX];
+	char link[PATH_MAX];       /**< symlink to the device, empty if none */
+
+	double phase;              /**< of the power curve */
+	double energy;             /**< meter reading in Wh */
+	double last;               /**< time of the last update of the energy */
+
+	double next;               /**< time of the next telegram or pulse */
+	double started;            /**< time the pending telegram started */
+	std::string out;           /**< pending telegram */
+	size_t sent;
+	bool requested;            /**< D0 pull mode: a request has been received */
+
+	unsigned long telegrams;
+	unsigned long long bytes;
+	unsigned long errors;      /**< telegrams or pulses with injected errors */
+	unsigned long long dropped;/**< bytes lost because nobody reads the line */
+	unsigned long outages;
+} meter_t;
+
+typedef struct {
+	unsigned int baudrate;     /**< 0 writes telegrams at once */
+	double interval;
+	double jitter;             /**< in seconds */
+	double error_rate;
+	double power;
+	unsigned int resolution;
+	bool pull;                 /**< D0 meters wait for a request */
+	const char *links;         /**< directory for symlinks to the devices */
+	double outage_period;      /**< every period the devices disappear */
+	double outage_length;      /**< for this many seconds */
+} sim_options_t;
+
+static volatile sig_atomic_t running = 1;
+
+static void quit(int sig) {
+	running = 0;
+}
+
+static double monotonic() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* seconds until the current outage at the end of a period ends, 0 if there is none */
+static double outage(const sim_options_t *opts, double elapsed) {
+	if (opts->outage_period <= 0) return 0;
+
+	double left = opts->outage_period - fmod(elapsed, opts->outage_period);
+	return (left <= opts->outage_length) ? left : 0;
+}
+
+/* uniformly distributed in [-1, 1] */
+static double noise() {
+	return 2 * drand48() - 1;
+}
+
+/* integrate the power since the last update */
+static double power(meter_t *mtr, const sim_options_t *opts, double now) {
+	double p = opts->power * (1 + 0.5 * sin(now / 60 + mtr->phase));
+
+	mtr->energy += p * (now - mtr->last) / 3600;
+	mtr->last = now;
+
+	return p;
+}
+
+/**
+ * Build an eHZ style D0 telegram
+ */
+static std::string d0_telegram(meter_t *mtr, double p) {
+	char buffer[256];
+
+	snprintf(buffer, sizeof(buffer),
+		"/ESY5Q3DA1004 V3.02\r\n"
+		"\r\n"
+		"1-0:0.0.0*255(%013d)\r\n"
+		"1-0:1.8.0*255(%013.4f*kWh)\r\n"
+		"1-0:1.7.255*255(%09.2f*W)\r\n"
+		"!\r\n",
+		mtr->index, mtr->energy / 1000, p);
+
+	return buffer;
+}
+
+/**
+ * SML encoding, just enough for an open, get list and close response
+ */
+static uint16_t sml_crc16(const std::string &data) {
+	uint16_t crc = 0xffff;
+
+	for (size_t i = 0; i < data.size(); i++) {
+		crc ^= (unsigned char) data[i];
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : (crc >> 1);
+		}
+	}
+	crc ^= 0xffff;
+
+	return (crc << 8) | (crc >> 8); /* transmitted big endian */
+}
+
+static void sml_crc(std::string &out, uint16_t crc) {
+	out += (char) (crc >> 8);
+	out += (char) (crc & 0xff);
+}
+
+static std::string sml_octet(const std::string &value) {
+	return std::string(1, (char) (value.size() + 1)) + value;
+}
+
+static std::string sml_int(unsigned char type, long long value, int len) {
+	std::string out(1, (char) (type | (len + 1)));
+
+	for (int i = len - 1; i >= 0; i--) {
+		out += (char) ((value >> (8 * i)) & 0xff);
+	}
+
+	return out;
+}
+
+static std::string sml_list(int n) {
+	return std::string(1, (char) (0x70 | n));
+}
+
+static const std::string sml_empty("\x01", 1);
+
+static std::string sml_message(char id, int tag, const std::string &body) {
+	std::string msg = sml_list(6) + sml_octet(std::string(1, id)) + sml_int(0x60, 0, 1) + sml_int(0x60, 0, 1)
+		+ sml_list(2) + sml_int(0x60, tag, 2) + body;
+
+	uint16_t crc = sml_crc16(msg);
+	msg += '\x63';
+	sml_crc(msg, crc);
+	msg += '\0'; /* end of message */
+
+	return msg;
+}
+
+static std::string sml_entry(const char *obis, int unit, unsigned char type, long long value, int len) {
+	return sml_list(7) + sml_octet(std::string(obis, 6)) + sml_empty + sml_empty
+		+ sml_int(0x60, unit, 1) + sml_int(0x50, -1, 1) + sml_int(type, value, len) + sml_empty;
+}
+
+static std::string sml_telegram(meter_t *mtr, double p) {
+	static const std::string escape("\x1b\x1b\x1b\x1b", 4);
+	std::string server("\x0a\x01" "EMH\0\0", 7);
+	std::string body;
+
+	server += (char) (mtr->index >> 8);
+	server += (char) (mtr->index & 0xff);
+	server += '\0';
+
+	/* the escape sequence must not show up in the data, nudge the counter in that case */
+	for (long long energy = llround(mtr->energy * 10); ; energy++) {
+		std::string values = sml_list(2)
+			+ sml_entry("\x01\x00\x01\x08\x00\xff", 30, 0x60, energy, 8)          /* 1.8.0 in 0.1 Wh */
+			+ sml_entry("\x01\x00\x10\x07\x00\xff", 27, 0x50, llround(p * 10), 4); /* 16.7.0 in 0.1 W */
+
+		body = sml_message(1, 0x0101, sml_list(6) + sml_empty + sml_empty + sml_octet("\x01\x02\x03")
+				+ sml_octet(server) + sml_empty + sml_empty)
+			+ sml_message(2, 0x0701, sml_list(7) + sml_empty + sml_octet(server) + sml_empty + sml_empty
+				+ values + sml_empty + sml_empty)
+			+ sml_message(3, 0x0201, sml_list(1) + sml_empty);
+
+		if (body.find(escape) == std::string::npos) break;
+	}
+
+	size_t padding = (4 - body.size() % 4) % 4;
+	std::string out = escape + std::string("\x01\x01\x01\x01", 4) + body + std::string(padding, '\0')
+		+ escape + '\x1a' + (char) padding;
+	sml_crc(out, sml_crc16(out));
+
+	return out;
+}
+
+/**
+ * Flip a bit or cut the telegram short
+ */
+static void corrupt(std::string &telegram) {
+	size_t pos = drand48() * telegram.size();
+
+	if (drand48() < 0.5) {
+		telegram[pos] ^= 1 << (int) (drand48() * 8);
+	}
+	else {
+		telegram.resize(pos);
+	}
+}
+
+static int open_meter(meter_t *mtr, const sim_options_t *opts) {
+	struct termios tio;
+
+	if (openpty(&mtr->master, &mtr->slave, mtr->device, NULL, NULL) < 0) {
+		fprintf(stderr, "openpty(): %s\n", strerror(errno));
+		return -1;
+	}
+
+	/* no echo or translation until the logger configures the port */
+	tcgetattr(mtr->slave, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(mtr->slave, TCSANOW, &tio);
+
+	/* a serial line has no flow control, bytes nobody reads are lost */
+	fcntl(mtr->master, F_SETFL, fcntl(mtr->master, F_GETFL) | O_NONBLOCK);
+
+	mtr->link[0] = '\0';
+	if (opts->links) {
+		char tmp[PATH_MAX + 4];
+
+		/* replaced atomically when the device is recreated after an outage */
+		snprintf(mtr->link, sizeof(mtr->link), "%s/%s%d", opts->links, protocol_names[mtr->protocol], mtr->index);
+		snprintf(tmp, sizeof(tmp), "%s.tmp", mtr->link);
+		unlink(tmp);
+		if (symlink(mtr->device, tmp) < 0 || rename(tmp, mtr->link) < 0) {
+			fprintf(stderr, "symlink(%s): %s\n", mtr->link, strerror(errno));
+			unlink(tmp);
+			mtr->link[0] = '\0';
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Make the device disappear like an unplugged adapter, the link is left dangling
+ */
+static void hangup_meter(meter_t *mtr) {
+	if (mtr->master < 0) return;
+
+	mtr->dropped += mtr->out.size() - mtr->sent;
+	mtr->sent = mtr->out.size();
+	mtr->requested = false;
+
+	close(mtr->slave);
+	close(mtr->master);
+	mtr->master = mtr->slave = -1;
+}
+
+static void close_meter(meter_t *mtr) {
+	if (mtr->link[0]) {
+		unlink(mtr->link);
+	}
+	hangup_meter(mtr);
+}
+
+/**
+ * Start the next telegram or pulse when it is due
+ */
+static void schedule(meter_t *mtr, const sim_options_t *opts, double now) {
+	if (mtr->sent < mtr->out.size()) return; /* still busy */
+
+	if (mtr->protocol == sim_d0 && opts->pull) {
+		if (!mtr->requested) return;
+		mtr->requested = false;
+	}
+	else if (now < mtr->next) {
+		return;
+	}
+
+	double p = power(mtr, opts, now);
+	double interval = opts->interval;
+
+	switch (mtr->protocol) {
+		case sim_d0:
+			mtr->out = d0_telegram(mtr, p);
+			break;
+
+		case sim_sml:
+			mtr->out = sml_telegram(mtr, p);
+			break;
+
+		case sim_s0:
+			mtr->out = std::string(1, '\0'); /* any character is a pulse */
+			interval = 3.6e6 / (p * opts->resolution);
+			break;
+	}
+
+	if (drand48() < opts->error_rate) {
+		if (mtr->protocol == sim_s0) {
+			mtr->next = now + SIM_BOUNCE; /* a bouncing contact */
+		}
+		else {
+			corrupt(mtr->out);
+			mtr->next += interval + opts->jitter * noise();
+		}
+		mtr->errors++;
+	}
+	else {
+		mtr->next += interval + opts->jitter * noise();
+	}
+
+	if (mtr->next < now) {
+		mtr->next = now; /* do not catch up after a stall */
+	}
+
+	mtr->started = now;
+	mtr->sent = 0;
+	mtr->telegrams++;
+}
+
+/**
+ * Write as many bytes as the line transmits until now
+ */
+static void transmit(meter_t *mtr, const sim_options_t *opts, double now) {
+	size_t due = mtr->out.size();
+
+	if (opts->baudrate > 0 && mtr->out.size() > 1) {
+		due = std::min(due, (size_t) ((now - mtr->started) * opts->baudrate / SIM_BITS) + 1);
+	}
+	if (due <= mtr->sent) return;
+
+	ssize_t written = write(mtr->master, mtr->out.data() + mtr->sent, due - mtr->sent);
+	if (written < 0) {
+		if (errno != EAGAIN && errno != EINTR) {
+			fprintf(stderr, "write(%s): %s\n", mtr->device, strerror(errno));
+		}
+		mtr->dropped += due - mtr->sent;
+		mtr->sent = due;
+	}
+	else {
+		mtr->bytes += written;
+		mtr->sent += written;
+	}
+}
+
+/* time until the next byte has to be written */
+static double timeout(meter_t *mtr, const sim_options_t *opts, double now) {
+	if (mtr->sent < mtr->out.size()) {
+		if (opts->baudrate == 0) return 0;
+		return std::max(0.0, mtr->started + (double) mtr->sent * SIM_BITS / opts->baudrate - now);
+	}
+	if (mtr->protocol == sim_d0 && opts->pull) {
+		return mtr->requested ? 0 : 1;
+	}
+
+	return std::max(0.0, mtr->next - now);
+}
+
+/* D0 pull sequence, e.g. "/?!\r\n" */
+static void receive(meter_t *mtr) {
+	char buffer[64];
+	ssize_t bytes = read(mtr->master, buffer, sizeof(buffer));
+
+	if (bytes > 0 && memchr(buffer, '?', bytes) != NULL) {
+		mtr->requested = true;
+	}
+}
+
+static void usage(const char *program) {
+	fprintf(stderr, "usage: %s [options] protocol[:count]...\n", program);
+	fprintf(stderr, "  -b baudrate    speed of the lines, 0 writes telegrams at once (default %d)\n", SIM_BAUDRATE);
+	fprintf(stderr, "  -i interval    seconds between two telegrams (default %.1f)\n", SIM_INTERVAL);
+	fprintf(stderr, "  -j jitter      random deviation of the interval in ms\n");
+	fprintf(stderr, "  -e rate        fraction of corrupted telegrams or bouncing pulses\n");
+	fprintf(stderr, "  -p power       average power in W (default %.0f)\n", SIM_POWER);
+	fprintf(stderr, "  -r resolution  S0 pulses per kWh (default %d)\n", SIM_RESOLUTION);
+	fprintf(stderr, "  -P             D0 meters only answer requests (pull mode)\n");
+	fprintf(stderr, "  -l directory   create symlinks <protocol><n> to the devices\n");
+	fprintf(stderr, "  -o period:len  close the devices for len seconds every period seconds\n");
+	fprintf(stderr, "  -t seconds     terminate after this time\n");
+	fprintf(stderr, "  -s seed        reproducible noise\n");
+	fprintf(stderr, "protocols: d0, sml, s0\n");
+}
+
+int main(int argc, char *argv[]) {
+	sim_options_t opts;
+	double duration = 0;
+	long seed = time(NULL);
+	int c;
+
+	opts.baudrate = SIM_BAUDRATE;
+	opts.interval = SIM_INTERVAL;
+	opts.jitter = 0;
+	opts.error_rate = 0;
+	opts.power = SIM_POWER;
+	opts.resolution = SIM_RESOLUTION;
+	opts.pull = false;
+	opts.links = NULL;
+	opts.outage_period = opts.outage_length = 0;
+
+	while ((c = getopt(argc, argv, "b:i:j:e:p:r:Pl:o:t:s:h")) != -1) {
+		switch (c) {
+			case 'b': opts.baudrate = strtoul(optarg, NULL, 10); break;
+			case 'i': opts.interval = strtod(optarg, NULL); break;
+			case 'j': opts.jitter = strtod(optarg, NULL) / 1e3; break;
+			case 'e': opts.error_rate = strtod(optarg, NULL); break;
+			case 'p': opts.power = strtod(optarg, NULL); break;
+			case 'r': opts.resolution = strtoul(optarg, NULL, 10); break;
+			case 'P': opts.pull = true; break;
+			case 'l': opts.links = optarg; break;
+			case 'o':
+				if (sscanf(optarg, "%lf:%lf", &opts.outage_period, &opts.outage_length) != 2
+						|| opts.outage_period <= 0 || opts.outage_length < 0 || opts.outage_length >= opts.outage_period) {
+					fprintf(stderr, "Invalid outage: %s\n", optarg);
+					return EXIT_FAILURE;
+				}
+				break;
+			case 't': duration = strtod(optarg, NULL); break;
+			case 's': seed = strtol(optarg, NULL, 10); break;
+			default:
+				usage(argv[0]);
+				return (c == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (optind == argc || opts.interval <= 0 || opts.power <= 0 || opts.resolution == 0) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	std::vector<meter_t> meters;
+	for (int i = optind; i < argc; i++) {
+		char name[16];
+		int count = 1;
+
+		if (sscanf(argv[i], "%15[^:]:%d", name, &count) < 1 || count < 1) {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+
+		int protocol;
+		for (protocol = 0; protocol <= sim_s0; protocol++) {
+			if (strcmp(name, protocol_names[protocol]) == 0) break;
+		}
+		if (protocol > sim_s0) {
+			fprintf(stderr, "Unknown protocol: %s\n", name);
+			return EXIT_FAILURE;
+		}
+
+		for (int n = 0; n < count; n++) {
+			meter_t mtr;
+
+			mtr.protocol = (sim_protocol_t) protocol;
+			mtr.index = meters.size();
+			mtr.master = mtr.slave = -1;
+			mtr.link[0] = '\0';
+			mtr.phase = mtr.index;
+			mtr.energy = 1e6 * (mtr.index + 1);
+			mtr.last = mtr.next = mtr.started = 0;
+			mtr.sent = 0;
+			mtr.requested = false;
+			mtr.telegrams = mtr.errors = 0;
+			mtr.bytes = mtr.dropped = 0;
+			mtr.outages = 0;
+			meters.push_back(mtr);
+		}
+	}
+
+	srand48(seed);
+	signal(SIGINT, quit);
+	signal(SIGTERM, quit);
+	signal(SIGPIPE, SIG_IGN);
+
+	double start = monotonic();
+	int ret = EXIT_SUCCESS;
+
+	for (size_t i = 0; i < meters.size(); i++) {
+		meter_t *mtr = &meters[i];
+
+		if (open_meter(mtr, &opts) < 0) {
+			ret = EXIT_FAILURE;
+			running = 0;
+			break;
+		}
+
+		/* spread the meters over the interval */
+		mtr->last = start;
+		mtr->next = start + opts.interval * drand48();
+
+		printf("%-4s %4d %s%s%s\n", protocol_names[mtr->protocol], mtr->index, mtr->device,
+			mtr->link[0] ? " " : "", mtr->link);
+	}
+	fflush(stdout);
+
+	std::vector<struct pollfd> fds(meters.size());
+
+	while (running) {
+		double now = monotonic();
+		double wait = 1;
+		double down = outage(&opts, now - start);
+
+		if (duration > 0 && now - start >= duration) break;
+
+		for (size_t i = 0; i < meters.size(); i++) {
+			meter_t *mtr = &meters[i];
+
+			if (down > 0 && mtr->master >= 0) {
+				hangup_meter(mtr);
+				mtr->outages++;
+			}
+			else if (down == 0 && mtr->master < 0) {
+				if (open_meter(mtr, &opts) < 0) {
+					ret = EXIT_FAILURE;
+					running = 0;
+					break;
+				}
+				printf("%-4s %4d %s%s%s\n", protocol_names[mtr->protocol], mtr->index, mtr->device,
+					mtr->link[0] ? " " : "", mtr->link);
+				fflush(stdout);
+			}
+
+			if (mtr->master < 0) {
+				fds[i].fd = -1; /* ignored by poll() */
+				fds[i].revents = 0;
+				wait = std::min(wait, down);
+				continue;
+			}
+
+			schedule(&meters[i], &opts, now);
+			transmit(&meters[i], &opts, now);
+			wait = std::min(wait, timeout(&meters[i], &opts, now));
+
+			fds[i].fd = meters[i].master;
+			fds[i].events = (meters[i].protocol == sim_d0 && opts.pull) ? POLLIN : 0;
+			fds[i].revents = 0;
+		}
+		if (!running) break;
+
+		if (poll(&fds[0], fds.size(), (int) ceil(wait * 1e3)) > 0) {
+			for (size_t i = 0; i < meters.size(); i++) {
+				if (fds[i].revents & POLLIN) {
+					receive(&meters[i]);
+				}
+			}
+		}
+	}
+
+	double elapsed = monotonic() - start;
+
+	printf("%-4s %4s %10s %12s %8s %12s %8s %12s\n", "", "", "telegrams", "bytes", "errors", "dropped", "outages", "telegrams/s");
+	for (size_t i = 0; i < meters.size(); i++) {
+		meter_t *mtr = &meters[i];
+
+		printf("%-4s %4d %10lu %12llu %8lu %12llu %8lu %12.2f\n", protocol_names[mtr->protocol], mtr->index,
+			mtr->telegrams, mtr->bytes, mtr->errors, mtr->dropped, mtr->outages, mtr->telegrams / elapsed);
+		close_meter(mtr);
+	}
+
+	return ret;
+}
@@ -0,0 +1,214 @@
+#!/usr/bin/env python3
+#
+# Mock volkszaehler.org middleware for load tests
+#
+# Accepts the readings posted by vzlogger to /data/<uuid>.json and measures
+# the age of every reading on arrival. Latency, errors and outages can be
+# injected to see how vzlogger copes with a slow or failing middleware.
+#
+# @package vzlogger
+# @copyright Copyright (c) 2011, The volkszaehler.org project
+# @license http://www.gnu.org/licenses/gpl.txt GNU Public License
+#
+# This file is part of volkzaehler.org
+#
+# volkzaehler.org is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# any later version.
+#
+# volkzaehler.org is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+
+import argparse
+import json
+import random
+import re
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+PATH = re.compile(r'/data/([0-9a-fA-F-]+)\.json$')
+
+
+def percentile(values, p):
+	"""nearest rank percentile of a sorted list"""
+	if not values:
+		return 0.0
+	rank = max(0, min(len(values) - 1, int(round(p / 100.0 * len(values) + 0.5)) - 1))
+	return values[rank]
+
+
+class Handler(BaseHTTPRequestHandler):
+	protocol_version = 'HTTP/1.1'	# keep-alive, like the real middleware behind apache
+
+	def log_message(self, format, *args):
+		if self.server.verbose:
+			BaseHTTPRequestHandler.log_message(self, format, *args)
+
+	def reply(self, code, body):
+		data = json.dumps(body).encode()
+		self.send_response(code)
+		self.send_header('Content-Type', 'application/json')
+		self.send_header('Content-Length', str(len(data)))
+		self.end_headers()
+		self.wfile.write(data)
+
+	def do_POST(self):
+		server = self.server
+		body = self.rfile.read(int(self.headers.get('Content-Length', 0)))
+
+		if server.in_outage():
+			server.count('dropped')
+			self.close_connection = True	# hang up without a response
+			return
+
+		if server.latency > 0 or server.jitter > 0:
+			time.sleep((server.latency + random.uniform(0, server.jitter)) / 1e3)
+
+		match = PATH.search(self.path.split('?')[0])
+		if match is None:
+			server.count('invalid')
+			self.reply(400, {'exception': {'type': 'Exception', 'message': 'Invalid path: ' + self.path}})
+			return
+
+		if random.random() < server.errors:
+			server.count('failed')
+			self.reply(500, {'exception': {'type': 'Exception', 'message': 'Injected error'}})
+			return
+
+		try:
+			tuples = json.loads(body.decode())
+		except ValueError as e:
+			server.count('invalid')
+			self.reply(400, {'exception': {'type': 'Exception', 'message': str(e)}})
+			return
+
+		server.record(match.group(1), tuples)
+		self.reply(200, {'version': '0.2', 'rows': len(tuples)})
+
+	do_PUT = do_POST
+
+
+class Middleware(ThreadingHTTPServer):
+	"""
+	@param latency  delay of every response in ms
+	@param jitter   additional random delay in ms, uniformly distributed
+	@param errors   fraction of requests answered with an exception
+	@param outage   (period, length) in seconds: every period the middleware
+	                hangs up on all requests for length seconds
+	"""
+	daemon_threads = True
+
+	def __init__(self, address, latency=0, jitter=0, errors=0.0, outage=None, verbose=False):
+		ThreadingHTTPServer.__init__(self, address, Handler)
+		self.latency = latency
+		self.jitter = jitter
+		self.errors = errors
+		self.outage = outage
+		self.verbose = verbose
+		self.started = time.time()
+		self.lock = threading.Lock()
+		self.reset()
+
+	def url(self):
+		return 'http://%s:%d/middleware.php' % self.server_address[:2]
+
+	def in_outage(self):
+		if not self.outage:
+			return False
+		period, length = self.outage
+		return (time.time() - self.started) % period < length
+
+	def reset(self):
+		with self.lock:
+			self.since = time.time()
+			self.counters = {'requests': 0, 'readings': 0, 'dropped': 0, 'failed': 0, 'invalid': 0}
+			self.latencies = []
+			self.channels = {}
+
+	def count(self, counter):
+		with self.lock:
+			self.counters['requests'] += 1
+			self.counters[counter] += 1
+
+	def record(self, uuid, tuples):
+		now = time.time() * 1e3
+		with self.lock:
+			self.counters['requests'] += 1
+			self.counters['readings'] += len(tuples)
+			self.channels[uuid] = self.channels.get(uuid, 0) + len(tuples)
+			self.latencies.extend(now - t[0] for t in tuples)
+
+	def stats(self):
+		"""counters and reading latency in ms since the last reset()"""
+		with self.lock:
+			elapsed = time.time() - self.since
+			latencies = sorted(self.latencies)
+			stats = dict(self.counters)
+			stats['channels'] = len(self.channels)
+
+		stats['elapsed'] = elapsed
+		stats['readings/s'] = stats['readings'] / elapsed if elapsed > 0 else 0.0
+		stats['p50'] = percentile(latencies, 50)
+		stats['p99'] = percentile(latencies, 99)
+		stats['max'] = latencies[-1] if latencies else 0.0
+		return stats
+
+
+def format_stats(stats):
+	return ('%(readings)d readings from %(channels)d channels in %(requests)d requests, '
+		'%(readings/s).1f readings/s, latency p50 %(p50).1f ms, p99 %(p99).1f ms, max %(max).1f ms, '
+		'%(failed)d failed, %(dropped)d dropped, %(invalid)d invalid' % stats)
+
+
+def parse_outage(value):
+	try:
+		period, length = (float(v) for v in value.split(':'))
+	except ValueError:
+		raise argparse.ArgumentTypeError('expected PERIOD:LENGTH in seconds')
+	if period <= 0 or length < 0 or length >= period:
+		raise argparse.ArgumentTypeError('the outage has to be shorter than its period')
+	return (period, length)
+
+
+def add_arguments(parser):
+	parser.add_argument('--latency', type=float, default=0, metavar='MS', help='delay of every response')
+	parser.add_argument('--jitter', type=float, default=0, metavar='MS', help='additional random delay')
+	parser.add_argument('--errors', type=float, default=0.0, metavar='FRACTION', help='requests answered with an exception')
+	parser.add_argument('--outage', type=parse_outage, metavar='PERIOD:LENGTH', help='hang up on all requests for LENGTH seconds every PERIOD seconds')
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Mock volkszaehler.org middleware')
+	parser.add_argument('--bind', default='127.0.0.1')
+	parser.add_argument('--port', type=int, default=8080)
+	parser.add_argument('--report', type=float, default=10, metavar='SECONDS', help='print statistics periodically')
+	parser.add_argument('-v', '--verbose', action='store_true', help='log every request')
+	add_arguments(parser)
+	args = parser.parse_args()
+
+	server = Middleware((args.bind, args.port), args.latency, args.jitter, args.errors, args.outage, args.verbose)
+	threading.Thread(target=server.serve_forever, daemon=True).start()
+	print('listening on %s' % server.url(), file=sys.stderr)
+
+	try:
+		while True:
+			time.sleep(args.report)
+			print(format_stats(server.stats()))
+			sys.stdout.flush()
+			server.reset()
+	except KeyboardInterrupt:
+		pass
+	finally:
+		server.shutdown()
+
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,460 @@
+/**
+ * Simulator of a Modbus TCP gateway or a RTU bus with a few slaves
+ *
+ * Serves changing coils, discrete inputs, holding and input registers
+ * with libmodbus. Latency, exception responses, lost responses and
+ * connection drops can be injected to test MeterModbus.
+ * In RTU mode the slaves are served on a pty, the device to open is
+ * linked to the given name, e.g. "modbus_sim -R /tmp/modbus0 -u 3".
+ *
+ * @package vzlogger
+ * @copyright Copyright (c) 2011, The volkszaehler.org project
+ * @license http://www.gnu.org/licenses/gpl.txt GNU Public License
+ */
+/*
+ * This file is part of volkzaehler.org
+ *
+ * volkzaehler.org is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * volkzaehler.org is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with volkszaehler.org. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <pty.h>
+#include <termios.h>
+#include <sys/socket.h>
+
+#include <vector>
+
+#include <modbus.h>
+
+#define SIM_ADDRESS "0.0.0.0"
+#define SIM_PORT 1502         /* 502 needs root */
+#define SIM_SLAVES 1
+#define SIM_REGISTERS 1000    /* of each kind and slave */
+#define SIM_BACKLOG 16
+#define SIM_RTU_GAP 50        /* ms of silence which end an incomplete RTU frame */
+
+typedef struct {
+	const char *address;
+	int port;
+	const char *link;          /**< serve RTU on a pty linked here, TCP if NULL */
+	int slaves;
+	int registers;
+	double latency;            /**< in seconds */
+	double jitter;             /**< in seconds */
+	double exception_rate;
+	int exception;             /**< code of injected exceptions */
+	double silence_rate;       /**< requests without a response */
+	double drop_rate;          /**< requests answered by closing the connection */
+	double outage_period;      /**< every period the gateway is unreachable */
+	double outage_length;      /**< for this many seconds */
+} sim_options_t;
+
+typedef struct {
+	unsigned long connections;
+	unsigned long requests;
+	unsigned long replies;
+	unsigned long exceptions;
+	unsigned long silenced;
+	unsigned long dropped;
+	unsigned long refused;
+} sim_stats_t;
+
+static volatile sig_atomic_t running = 1;
+
+static void quit(int sig) {
+	running = 0;
+}
+
+static double monotonic() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool in_outage(const sim_options_t *opts, double elapsed) {
+	return opts->outage_period > 0 && fmod(elapsed, opts->outage_period) < opts->outage_length;
+}
+
+/**
+ * Registers count up once a second, every slave from another base
+ */
+static void update(std::vector<modbus_mapping_t *> &mappings, long seconds) {
+	for (size_t s = 0; s < mappings.size(); s++) {
+		modbus_mapping_t *map = mappings[s];
+
+		for (int i = 0; i < map->nb_registers; i++) {
+			map->tab_registers[i] = (uint16_t) ((s + 1) * 1000 + i + seconds);
+			map->tab_input_registers[i] = (uint16_t) ((s + 1) * 2000 + i + seconds);
+		}
+		for (int i = 0; i < map->nb_bits; i++) {
+			map->tab_bits[i] = (i + seconds) & 1;
+			map->tab_input_bits[i] = ((i + seconds) >> 1) & 1;
+		}
+	}
+}
+
+static uint16_t crc16(const uint8_t *data, int len) {
+	uint16_t crc = 0xffff;
+
+	for (int i = 0; i < len; i++) {
+		crc ^= data[i];
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc & 1) ? (crc >> 1) ^ 0xa001 : crc >> 1;
+		}
+	}
+
+	return crc;
+}
+
+/**
+ * Read a RTU request, its length follows from the function code
+ *
+ * modbus_receive() ignores requests for other slaves than the one of the
+ * context in RTU mode, so the frames are read here to serve several slaves.
+ *
+ * @return length including the crc, 0 if the frame is incomplete or corrupted
+ */
+static int receive_rtu(int fd, uint8_t *query) {
+	int len = 0;
+	int expected = 8; /* slave, function, address, count or value, crc */
+
+	while (len < expected) {
+		struct pollfd pfd = { fd, POLLIN, 0 };
+		if (poll(&pfd, 1, SIM_RTU_GAP) <= 0) {
+			return 0;
+		}
+
+		ssize_t bytes = read(fd, query + len, expected - len);
+		if (bytes <= 0) {
+			return 0;
+		}
+		len += bytes;
+
+		/* write multiple coils or registers: byte count follows the quantity */
+		if (len >= 7 && (query[1] == 0x0f || query[1] == 0x10)) {
+			expected = 9 + query[6];
+			if (expected > MODBUS_RTU_MAX_ADU_LENGTH) return 0;
+		}
+	}
+
+	if (crc16(query, len - 2) != (query[len - 2] | (query[len - 1] << 8))) {
+		uint8_t garbage[64];
+		struct pollfd pfd = { fd, POLLIN, 0 };
+
+		/* resynchronize on the next gap */
+		while (poll(&pfd, 1, SIM_RTU_GAP) > 0 && read(fd, garbage, sizeof(garbage)) > 0);
+		return 0;
+	}
+
+	return len;
+}
+
+/**
+ * Answer a single request
+ *
+ * @return false if the connection has to be closed
+ */
+static bool serve(modbus_t *ctx, int fd, std::vector<modbus_mapping_t *> &mappings,
+	const sim_options_t *opts, sim_stats_t *stats, double elapsed) {
+	uint8_t query[MODBUS_TCP_MAX_ADU_LENGTH];
+	int rc;
+
+	if (opts->link) {
+		rc = receive_rtu(fd, query);
+		if (rc == 0) return true; /* corrupted */
+	}
+	else {
+		modbus_set_socket(ctx, fd);
+		rc = modbus_receive(ctx, query);
+		if (rc == 0) return true; /* ignored */
+		if (rc < 0) return false; /* closed by the client */
+	}
+
+	stats->requests++;
+
+	if (in_outage(opts, elapsed) || drand48() < opts->drop_rate) {
+		stats->dropped++;
+		return false;
+	}
+	if (drand48() < opts->silence_rate) {
+		stats->silenced++;
+		return true;
+	}
+
+	if (opts->latency > 0 || opts->jitter > 0) {
+		usleep((opts->latency + opts->jitter * drand48()) * 1e6);
+	}
+
+	/* unit identifier in the MBAP header, 0 and 255 address the gateway itself */
+	int slave = query[modbus_get_header_length(ctx) - 1];
+	if (opts->link) {
+		if (slave == MODBUS_BROADCAST_ADDRESS || slave > (int) mappings.size()) {
+			stats->silenced++; /* no other device on the bus answers either */
+			return true;
+		}
+		modbus_set_slave(ctx, slave);
+	}
+	else if (slave == 0 || slave == MODBUS_TCP_SLAVE) {
+		slave = 1;
+	}
+
+	if (slave > (int) mappings.size()) {
+		stats->exceptions++;
+		modbus_reply_exception(ctx, query, MODBUS_EXCEPTION_GATEWAY_TARGET);
+	}
+	else if (drand48() < opts->exception_rate) {
+		stats->exceptions++;
+		modbus_reply_exception(ctx, query, opts->exception);
+	}
+	else {
+		stats->replies++;
+		modbus_reply(ctx, query, rc, mappings[slave - 1]);
+	}
+
+	return true;
+}
+
+/**
+ * Create the pty of the RTU bus and link its slave end
+ *
+ * The slave end is kept open, the master would report a hangup whenever
+ * the meter closes the device otherwise.
+ */
+static bool open_rtu(const char *link, int *master, int *slave, char *path) {
+	struct termios tio;
+
+	if (openpty(master, slave, path, NULL, NULL) < 0) {
+		fprintf(stderr, "openpty(): %s\n", strerror(errno));
+		return false;
+	}
+
+	/* no echo or translation until the meter has configured the port */
+	tcgetattr(*slave, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(*slave, TCSANOW, &tio);
+
+	unlink(link);
+	if (symlink(path, link) < 0) {
+		fprintf(stderr, "symlink(%s, %s): %s\n", path, link, strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+static bool parse_outage(const char *arg, sim_options_t *opts) {
+	return sscanf(arg, "%lf:%lf", &opts->outage_period, &opts->outage_length) == 2
+		&& opts->outage_period > 0 && opts->outage_length >= 0 && opts->outage_length < opts->outage_period;
+}
+
+static void usage(const char *program) {
+	fprintf(stderr, "usage: %s [options]\n", program);
+	fprintf(stderr, "  -a address     to listen on (default %s)\n", SIM_ADDRESS);
+	fprintf(stderr, "  -p port        (default %d)\n", SIM_PORT);
+	fprintf(stderr, "  -R link        serve RTU on a pty linked to this name instead of TCP\n");
+	fprintf(stderr, "  -u slaves      unit ids 1 to slaves, others get a gateway exception or no response (default %d)\n", SIM_SLAVES);
+	fprintf(stderr, "  -r registers   coils, inputs and registers of each kind per slave (default %d)\n", SIM_REGISTERS);
+	fprintf(stderr, "  -l latency     delay of every response in ms\n");
+	fprintf(stderr, "  -j jitter      additional random delay in ms\n");
+	fprintf(stderr, "  -e rate        fraction of requests answered with an exception\n");
+	fprintf(stderr, "  -x code        of the injected exceptions (default %d, slave device busy)\n", MODBUS_EXCEPTION_SLAVE_OR_SERVER_BUSY);
+	fprintf(stderr, "  -n rate        fraction of requests without a response\n");
+	fprintf(stderr, "  -d rate        fraction of requests answered by closing the connection, not at all for RTU\n");
+	fprintf(stderr, "  -o period:len  unreachable for len seconds every period seconds\n");
+	fprintf(stderr, "  -t seconds     terminate after this time\n");
+	fprintf(stderr, "  -s seed        reproducible injections\n");
+	fprintf(stderr, "  -v             print the frames\n");
+}
+
+int main(int argc, char *argv[]) {
+	sim_options_t opts;
+	sim_stats_t stats;
+	double duration = 0;
+	long seed = time(NULL);
+	bool debug = false;
+	int c;
+
+	opts.address = SIM_ADDRESS;
+	opts.port = SIM_PORT;
+	opts.link = NULL;
+	opts.slaves = SIM_SLAVES;
+	opts.registers = SIM_REGISTERS;
+	opts.latency = opts.jitter = 0;
+	opts.exception_rate = 0;
+	opts.exception = MODBUS_EXCEPTION_SLAVE_OR_SERVER_BUSY;
+	opts.silence_rate = opts.drop_rate = 0;
+	opts.outage_period = opts.outage_length = 0;
+
+	while ((c = getopt(argc, argv, "a:p:R:u:r:l:j:e:x:n:d:o:t:s:vh")) != -1) {
+		switch (c) {
+			case 'a': opts.address = optarg; break;
+			case 'p': opts.port = atoi(optarg); break;
+			case 'R': opts.link = optarg; break;
+			case 'u': opts.slaves = atoi(optarg); break;
+			case 'r': opts.registers = atoi(optarg); break;
+			case 'l': opts.latency = strtod(optarg, NULL) / 1e3; break;
+			case 'j': opts.jitter = strtod(optarg, NULL) / 1e3; break;
+			case 'e': opts.exception_rate = strtod(optarg, NULL); break;
+			case 'x': opts.exception = atoi(optarg); break;
+			case 'n': opts.silence_rate = strtod(optarg, NULL); break;
+			case 'd': opts.drop_rate = strtod(optarg, NULL); break;
+			case 'o':
+				if (!parse_outage(optarg, &opts)) {
+					fprintf(stderr, "Invalid outage: %s\n", optarg);
+					return EXIT_FAILURE;
+				}
+				break;
+			case 't': duration = strtod(optarg, NULL); break;
+			case 's': seed = strtol(optarg, NULL, 10); break;
+			case 'v': debug = true; break;
+			default:
+				usage(argv[0]);
+				return (c == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (optind != argc || opts.slaves < 1 || opts.slaves > 247 || opts.registers < 1 || opts.registers > 65536) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	char path[PATH_MAX];
+	int server, slave = -1;
+	modbus_t *ctx;
+
+	if (opts.link) {
+		if (!open_rtu(opts.link, &server, &slave, path)) {
+			return EXIT_FAILURE;
+		}
+		/* the settings do not matter on a pty, the context is used for the replies */
+		ctx = modbus_new_rtu(path, 9600, 'N', 8, 1);
+	}
+	else {
+		ctx = modbus_new_tcp(opts.address, opts.port);
+	}
+	if (ctx == NULL) {
+		fprintf(stderr, "modbus_new_%s(): %s\n", opts.link ? "rtu" : "tcp", modbus_strerror(errno));
+		return EXIT_FAILURE;
+	}
+	modbus_set_debug(ctx, debug);
+
+	std::vector<modbus_mapping_t *> mappings;
+	for (int s = 0; s < opts.slaves; s++) {
+		modbus_mapping_t *map = modbus_mapping_new(opts.registers, opts.registers, opts.registers, opts.registers);
+		if (map == NULL) {
+			fprintf(stderr, "modbus_mapping_new(): %s\n", modbus_strerror(errno));
+			return EXIT_FAILURE;
+		}
+		mappings.push_back(map);
+	}
+
+	if (opts.link) {
+		modbus_set_socket(ctx, server); /* served on the master end */
+	}
+	else if ((server = modbus_tcp_listen(ctx, SIM_BACKLOG)) < 0) {
+		fprintf(stderr, "modbus_tcp_listen(%d): %s\n", opts.port, modbus_strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	srand48(seed);
+	signal(SIGINT, quit);
+	signal(SIGTERM, quit);
+	signal(SIGPIPE, SIG_IGN);
+	memset(&stats, 0, sizeof(stats));
+
+	if (opts.link) {
+		printf("serving %d slaves on %s (%s)\n", opts.slaves, opts.link, path);
+	}
+	else {
+		printf("listening on %s:%d with %d slaves\n", opts.address, opts.port, opts.slaves);
+	}
+	fflush(stdout);
+
+	/* requests are served one at a time, like a gateway to a serial bus does */
+	std::vector<struct pollfd> fds(1);
+	fds[0].fd = server;
+	fds[0].events = POLLIN;
+
+	double start = monotonic();
+	long seconds = -1;
+
+	while (running) {
+		double elapsed = monotonic() - start;
+		if (duration > 0 && elapsed >= duration) break;
+
+		if ((long) elapsed != seconds) {
+			seconds = (long) elapsed;
+			update(mappings, seconds);
+		}
+
+		if (poll(&fds[0], fds.size(), 100) <= 0) continue;
+
+		for (size_t i = fds.size(); i-- > 1; ) {
+			if (fds[i].revents == 0) continue;
+
+			if (!(fds[i].revents & POLLIN) || !serve(ctx, fds[i].fd, mappings, &opts, &stats, elapsed)) {
+				close(fds[i].fd);
+				fds.erase(fds.begin() + i);
+			}
+		}
+
+		if (opts.link) {
+			if (fds[0].revents & POLLIN) {
+				serve(ctx, server, mappings, &opts, &stats, elapsed); /* a bus can not be dropped */
+			}
+		}
+		else if (fds[0].revents & POLLIN) {
+			int fd = accept(server, NULL, NULL);
+			if (fd < 0) continue;
+
+			if (in_outage(&opts, elapsed)) {
+				stats.refused++;
+				close(fd);
+				continue;
+			}
+
+			struct pollfd client = { fd, POLLIN, 0 };
+			fds.push_back(client);
+			stats.connections++;
+		}
+	}
+
+	printf("%lu connections, %lu refused, %lu requests, %lu replies, %lu exceptions, %lu without response, %lu dropped\n",
+		stats.connections, stats.refused, stats.requests, stats.replies, stats.exceptions, stats.silenced, stats.dropped);
+
+	for (size_t i = 1; i < fds.size(); i++) {
+		close(fds[i].fd);
+	}
+	close(server);
+	if (opts.link) {
+		close(slave);
+		unlink(opts.link);
+	}
+	for (size_t s = 0; s < mappings.size(); s++) {
+		modbus_mapping_free(mappings[s]);
+	}
+	modbus_free(ctx);
+
+	return EXIT_SUCCESS;
+}
@@ -36,6 +36,8 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/signalfd.h>
 
 #include <list>
 
@@ -45,6 +47,7 @@
 #include "vzlogger.h"
 #include "Channel.hpp"
 #include "threads.h"
+#include <Clock.hpp>
 
 #ifdef LOCAL_SUPPORT
 #include "local.h"
@@ -53,7 +56,6 @@
 
 MapContainer mappings;	/* mapping between meters and channels */
 Config_Options options;	/* global application options */
-bool gStop = false;
 
 /**
  * Command line options
@@ -68,6 +70,7 @@ const struct option long_options[] = {
 	{"httpd-port",	required_argument,	0,	'p'},
 #endif /* LOCAL_SUPPORT */
 	{"register",		no_argument,	0,	'r'},
+	{"warp",	required_argument,	0,	'w'},
 	{"verbose",	required_argument,	0,	'v'},
 	{"help",	no_argument,		0,	'h'},
 	{"version",	no_argument,		0,	'V'},
@@ -87,6 +90,7 @@ const char *long_options_descs[] = {
 	"TCP port for HTTPd",
 #endif /* LOCAL_SUPPORT */
 	"register device",
+	"replay this many seconds on a virtual clock as fast as possible",
 	"enable verbose output",
 	"show this help",
 	"show version of vzlogger",
@@ -229,14 +233,80 @@ void daemonize() {
 }
 
 /**
- * Cancel threads
+ * Wait for a signal or the end of all reading threads
  *
- * Threads gets joined in main()
+ * The signals have to be blocked in all threads, they are received
+ * synchronously via a signalfd.
+ *
+ * @return the signal or 0 if all reading threads terminated
  */
-void quit(int sig) {
-	//gStop = true;
-	mappings.quit(sig);
-	exit(1);
+int supervise() {
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGHUP);
+	sigaddset(&signals, SIGTERM);
+
+	int sfd = signalfd(-1, &signals, SFD_CLOEXEC);
+	if (sfd < 0) {
+		print(log_error, "Cannot create signalfd: %s", (char*)0, strerror(errno));
+		return 0;
+	}
+
+	struct pollfd fds[2];
+	fds[0].fd = sfd;
+	fds[0].events = POLLIN;
+	fds[1].fd = mappings.finished();
+	fds[1].events = POLLIN;
+
+	int sig = 0;
+
+	while (mappings.reading() > 0 && sig == 0) {
+		/* check the meters once per second if any of them is watched */
+		int timeout = mappings.watchdog() ? 1000 : -1;
+
+		if (poll(fds, 2, timeout) < 0) {
+			if (errno == EINTR) continue;
+			print(log_error, "Cannot wait for signals: %s", (char*)0, strerror(errno));
+			break;
+		}
+
+		if (fds[0].revents & POLLIN) {
+			struct signalfd_siginfo info;
+			if (read(sfd, &info, sizeof(info)) == sizeof(info)) {
+				sig = info.ssi_signo;
+			}
+		}
+		if (fds[1].revents & POLLIN) {
+			char c;
+			if (read(fds[1].fd, &c, 1) < 0) {
+				print(log_error, "Cannot read notification: %s", (char*)0, strerror(errno));
+			}
+		}
+	}
+
+	close(sfd);
+	return sig;
+}
+
+/**
+ * Reload the meters and channels from the configuration file
+ *
+ * Only changed meters and channels are restarted, the global options are kept.
+ */
+void reload() {
+	MapContainer fresh;
+
+	print(log_info, "Reloading configuration from %s", (char*)0, options.config().c_str());
+	try {
+		Config_Options parsed(options.config());
+		parsed.config_parse(fresh);
+	} catch ( std::exception &e) {
+		print(log_error, "Keeping the current configuration: %s", (char*)0, e.what());
+		return;
+	}
+
+	mappings.reload(fresh, options.shutdown_timeout());
 }
 
 /**
@@ -248,7 +318,7 @@ void quit(int sig) {
 int config_parse_cli(int argc, char * argv[], Config_Options * options) {
 	options->local(1);
 	while (1) {
-		int c = getopt_long(argc, argv, "c:o:p:lhrVdfv:", long_options, NULL);
+		int c = getopt_long(argc, argv, "c:o:p:lhrVdfv:w:", long_options, NULL);
 
 		/* detect the end of the options. */
 		if (c == -1) break;
@@ -293,6 +363,14 @@ int config_parse_cli(int argc, char * argv[], Config_Options * options) {
 					options->doRegistration(1);
 					break;
 
+				case 'w': /* time-warp */
+					if (atof(optarg) <= 0) {
+						print(log_error, "Invalid time-warp duration: %s", (char*)0, optarg);
+						return ERR;
+					}
+					vz::Clock::warp(atof(optarg));
+					break;
+
 				case '?':
 				case 'h':
 				default:
@@ -332,21 +410,20 @@ void register_device() {
  */
 int main(int argc, char *argv[]) {
 
-	/* bind signal handler */
-	struct sigaction action;
-	sigemptyset(&action.sa_mask);
-	action.sa_flags = 0;
-	action.sa_handler = quit;
+	/* block termination signals in all threads, they are handled by supervise()
+	 * the mask is inherited by child processes: MeterExec::_spawn() resets it */
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);	/* ctrl-c from terminal */
+	sigaddset(&signals, SIGHUP);	/* hangup */
+	sigaddset(&signals, SIGTERM);	/* kill */
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
 
 #ifdef LOCAL_SUPPORT
 	/* webserver for local interface */
 	struct MHD_Daemon *httpd_handle = NULL;
 #endif /* LOCAL_SUPPORT */
 
-	sigaction(SIGINT, &action, NULL);	/* catch ctrl-c from terminal */
-	sigaction(SIGHUP, &action, NULL);	/* catch hangup signal */
-	sigaction(SIGTERM, &action, NULL);	/* catch kill signal */
-
 	/* initialize ADTs and APIs */
 	curl_global_init(CURL_GLOBAL_ALL);
 
@@ -407,9 +484,7 @@ int main(int argc, char *argv[]) {
 	print(log_debug, "===> Start meters.", "");
 	try {
 		/* open connection meters & start threads */
-		for(MapContainer::iterator it = mappings.begin(); it!=mappings.end(); it++) {
-			it->start();
-		}
+		mappings.start();
 
 #ifdef LOCAL_SUPPORT
 		/* start webserver for local interface */
@@ -429,16 +504,18 @@ int main(int argc, char *argv[]) {
 	}
 	print(log_debug, "Startup done.", "");
 
+	int sig;
+	while ((sig = supervise()) == SIGHUP) {
+		reload();
+	}
+	if (sig > 0) {
+		print(log_info, "Terminating on signal %d", (char*)0, sig);
+	}
+
 	try {
-		do {
-			/* wait for all threads to terminate */
-			for(MapContainer::iterator it = mappings.begin(); it!=mappings.end(); it++) {
-				bool ret = it->stopped();
-				if(ret) gStop = true;
-			}
-		} while (!gStop);
+		mappings.shutdown(options.shutdown_timeout());
 	} catch ( std::exception &e) {
-		print(log_error, "MainLOOP failed for %s", "", e.what());
+		print(log_error, "Shutdown failed for %s", "", e.what());
 	}
 	print(log_debug, "Server stopped.", "");
 